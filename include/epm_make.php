@@ -929,8 +929,8 @@ function get_status ( $workdir, $sfile )
 	    return NULL;
 	$c = trim ( $c );
 	$c = explode ( ' ', $c );
-	if ( count ( $c ) != 19 ) continue;
-	if ( $c[0] != $c[18] ) continue;
+	if ( count ( $c ) != 20 ) continue;
+	if ( $c[0] != $c[19] ) continue;
 	$state    = $c[1];
 	$cputime  = $c[3];
 	$space    = $c[4];
@@ -966,6 +966,10 @@ function get_status ( $workdir, $sfile )
 
     if ( $state == 'R' )
         return [$sfile, 'R', $time];
+    elseif ( $state == 'W' || $state == 'I' )
+	return [$sfile, 'F', $time, $signal + 128,
+	        ( $state == 'W' ? 'Wall Clock' : 'Idle' )
+		. ' Time Limit Exceeded'];
     elseif ( $state == 'E' && $exitcode == 0 )
         return [$sfile, 'S', $time];
     elseif ( $state == 'E' )
@@ -1051,6 +1055,9 @@ function get_exit_message
 	case 15:
 	    return 'Terminated by Termination Signal';
 	    break;
+	case 31:
+	    return 'Terminated by Forbidden System Call';
+	    break;
 	default:
 	    return "Command Failed with Signal "
 	         . ( $code - 128 );
@@ -26,10 +26,25 @@
 #include <sys/wait.h>
 #include <sys/param.h>
 #include <sys/signal.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <pwd.h>
 #include <grp.h>
+#include <linux/perf_event.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stddef.h>
+#include <sys/prctl.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <linux/audit.h>
+#include <linux/magic.h>
+#include <sys/vfs.h>
 
 char documentation [] =
 "epm_sandbox [options] program argument ...\n"
@@ -46,6 +61,8 @@ char documentation [] =
 "      -core N        Core Dump Size in Bytes\n"
 "      -openfiles N   Number of Open Files\n"
 "      -processes N   Number of Processes\n"
+"      -memory N      Memory Size in Bytes (needs\n"
+"                     -cgroup)\n"
 "\n"
 "    Here N is a non-negative decimal integer that\n"
 "    can end with `k' to multiply it by 1024 or `m'\n"
@@ -70,12 +87,52 @@ char documentation [] =
 "    diagnosed.  These options imply `-cputime N'\n"
 "    for T + 1 <= N <= T + 2 unless -cputime is\n"
 "    explicitly given.\n"
+"\n"
+"    Programs that do not use CPU time, e.g., be-\n"
+"    cause they are blocked reading input or are\n"
+"    sleeping, can be stopped by the options:\n"
+"\n"
+"      -walltime W    Wall Clock Time in Seconds\n"
+"      -idle I        Idle Time in Seconds\n"
+"\n"
+"    These kill the program with SIGKILL when W\n"
+"    seconds have elapsed since it started, or when\n"
+"    it has used no CPU time for the last I seconds\n"
+"    (checked every min(0.5,I/4) seconds).  W and I\n"
+"    may have fractional parts.  With -cgroup, the\n"
+"    CPU time of all processes in the cgroup counts\n"
+"    for -idle.  Otherwise only the CPU time of the\n"
+"    program's own process counts, not that of its\n"
+"    children, so a shell or other wrapper waiting\n"
+"    for a busy child is killed by -idle.\n"
+"\n"
+"    So that programs run in parallel get reproduc-\n"
+"    ible CPU times, the program can be placed by:\n"
+"\n"
+"      -cpus LIST     Run Only on the CPUs in LIST\n"
+"      -numa NODE     Allocate Memory Only on NUMA\n"
+"                     Node NODE\n"
+"      -sched POLICY  Scheduling Policy\n"
+"\n"
+"    LIST is a comma separated list of CPU numbers\n"
+"    and ranges, e.g., `2,3' or `0-3,8', as in\n"
+"    /sys/devices/system/cpu/online.  Without -cpus,\n"
+"    -numa NODE also runs the program only on the\n"
+"    CPUs of NODE.  POLICY is one of `other', `batch',\n"
+"    `idle', `fifo', or `rr' (see sched(7)).  The\n"
+"    policy is set after the child's user ID is\n"
+"    changed, so `fifo' and `rr', which use the low-\n"
+"    est real-time priority, need an RLIMIT_RTPRIO\n"
+"    for that user of at least 1.  They also set\n"
+"    RLIMIT_RTTIME to CPUTIME if that is limited.\n"
 "\f\n"
-"    There are also three other options:\n"
+"    There are also five other options:\n"
 "\n"
 "      -status STATUS-FILE\n"
 "      -score SCORE-FILE\n"
+"      -report REPORT-FILE\n"
 "      -env ENV-PARAM\n"
+"      -cgroup DIR\n"
 "\n"
 "    With a STATUS-FILE the status of the child proc-\n"
 "    ess that executes `program ...' is written into\n"
@@ -90,6 +147,8 @@ char documentation [] =
 "                     R  running\n"
 "                     E  terminated with exit code\n"
 "                     S  terminated with signal\n"
+"                     W  killed by -walltime\n"
+"                     I  killed by -idle\n"
 "        PID        process ID\n"
 "        CPUTIME    -cputime limit (seconds)\n"
 "        SPACE      -space limit (bytes)\n"
@@ -106,27 +165,107 @@ char documentation [] =
 "        USERTIME   user mode cpu time (sec)\n"
 "        SYSTIME    system mode cpu time (sec)\n"
 "        MAXRSS     max resident set size (kilobytes)\n"
+"        CPUS       CPUs the child may run on, in\n"
+"                   -cpus LIST format\n"
 "        COUNT      copy of COUNT.\n"
 "\f\n"
 "    All fields are integer except USERTIME, SYSTIME,\n"
-"    and T are floating point and unset limit fields\n"
-"    are `unlimited'.  EXITCODE and SIGNAL are unused\n"
-"    and 0 if STATE is R.  If beginning and ending\n"
-"    COUNT do not match, or STATUS-FILE is empty,\n"
-"    re-read the file as a race condition is likely.\n"
+"    and T are floating point, CPUS is a LIST, and\n"
+"    unset limit fields are `unlimited'.  EXITCODE\n"
+"    and SIGNAL are unused and 0 if STATE is R.\n"
+"    SIGNAL is 9 (SIGKILL) if STATE is W or I.  If\n"
+"    beginning and ending COUNT do not match, or\n"
+"    STATUS-FILE is empty, re-read the file as a\n"
+"    race condition is likely.\n"
 "\n"
 "    The SCORE-FILE if present is not written unless\n"
 "    `program ...' terminates with a signal or with\n"
-"    an exit code other than 0.  In this case a score\n"
+"    an exit code other than 0, or is killed by\n"
+"    -walltime or -idle.  In this case a score\n"
 "    describing the reason for termination is written\n"
 "    to SCORE-FILE.\n"
 "\n"
+"    The REPORT-FILE if present is written when\n"
+"    `program ...' terminates, with one `KEY VALUE'\n"
+"    line for each of:\n"
+"\n"
+"        USERTIME     as in STATUS-FILE\n"
+"        SYSTIME      as in STATUS-FILE\n"
+"        WALLTIME     elapsed time (sec)\n"
+"        MAXRSS       as in STATUS-FILE\n"
+"        MINFLT       minor page faults\n"
+"        MAJFLT       major page faults\n"
+"        NVCSW        voluntary context switches\n"
+"        NIVCSW       involuntary context switches\n"
+"        INBLOCK      file system input blocks\n"
+"        OUBLOCK      file system output blocks\n"
+"        RCHAR        bytes read\n"
+"        WCHAR        bytes written\n"
+"        READ_BYTES   bytes read from storage\n"
+"        WRITE_BYTES  bytes written to storage\n"
+"        INSTRUCTIONS user mode instructions\n"
+"        CYCLES       user mode CPU cycles\n"
+"\n"
+"    The first 10 come from getrusage(2) and include\n"
+"    all the child's descendants; RCHAR through\n"
+"    WRITE_BYTES come from /proc/PID/io of the child,\n"
+"    read just before it is reaped, and include only\n"
+"    the descendants the child has waited for.\n"
+"    INSTRUCTIONS and CYCLES are hardware counters\n"
+"    that include the child's descendants, and are\n"
+"    omitted if perf_event_open(2) is not available.\n"
+"    Lines whose values cannot be read are omitted.\n"
+"\f\n"
 "    Without any -env options, the environment in\n"
 "    which `program ...' executes is empty.  There\n"
 "    can be zero or more `-env ENV-PARAM' options,\n"
 "    each of which adds its ENV-PARAM to the environ-\n"
 "    ment in which `program ...' executes.\n"
 "\n"
+"    With -cgroup, DIR must be a cgroup v2 directory\n"
+"    owned by (delegated to) epm_sandbox's real user\n"
+"    ID, which must be able to reach it.\n"
+"    The child is run in a new cgroup created in DIR\n"
+"    and removed, after killing any processes left\n"
+"    in it, when the child terminates.  -memory sets\n"
+"    its memory.max, which limits the memory actu-\n"
+"    ally used by the child and its descendants, un-\n"
+"    like -space which limits reserved address space\n"
+"    (e.g., of JVMs).  -processes also sets its\n"
+"    pids.max if DIR enables the pids controller.\n"
+"    When the child terminates, the final USERTIME\n"
+"    and SYSTIME are read from its cpu.stat and MAX-\n"
+"    RSS from its memory.peak (if any), and so in-\n"
+"    clude all the child's descendants.  If the\n"
+"    memory controller killed a process for exceed-\n"
+"    ing -memory, the SCORE-FILE says so.\n"
+"\n"
+"    With `-seccomp PROFILE', a seccomp(2) filter\n"
+"    is installed in the child just before it exe-\n"
+"    cutes `program', and any system call the filter\n"
+"    forbids kills the child with SIGSYS, giving the\n"
+"    score `Terminated by Forbidden System Call'.\n"
+"    PROFILE is one of:\n"
+"\n"
+"        java    Forbids system calls for debugging\n"
+"                other processes, administering the\n"
+"                system, loading kernel modules, and\n"
+"                creating namespaces, as well as\n"
+"                bpf, perf_event_open, io_uring, key-\n"
+"                rings, and userfaultfd.\n"
+"        python  As java, plus socket (and, on\n"
+"                i386, socketcall).\n"
+"        c       As python, plus creating processes\n"
+"                (clone without CLONE_THREAD, fork,\n"
+"                vfork).\n"
+"\n"
+"    clone3 fails with ENOSYS so the C library uses\n"
+"    clone, whose flags the filter can check.  The\n"
+"    filter kills the child if it makes system calls\n"
+"    for another architecture (e.g., x32 or i386 on\n"
+"    x86_64).  -seccomp is supported on x86_64,\n"
+"    i386, and aarch64.\n"
+"\n"
 "    If `program' is not in the current directory,\n"
 "    it is looked up using epm_sandbox's environment\n"
 "    PATH variable after the manner of the UNIX shell\n"
@@ -179,10 +318,17 @@ char documentation [] =
 "    if any system call or option is in error.\n"
 "\n"
 "    When the -status or -SIG... options are given,\n"
-"    epm_sandbox polls the USERTIME and SYSTIME and\n"
-"    writes the status file or sends an interrupt\n"
-"    when it polls.  The polling interval is 0.5\n"
-"    seconds.\n"
+"    epm_sandbox waits for the first of the child's\n"
+"    termination, a CPU timer on the child that ex-\n"
+"    pires after T seconds of child CPU time and\n"
+"    sends the -SIG... signal, or, with -status, a\n"
+"    0.5 second interval timer that rewrites the\n"
+"    status file with the current USERTIME and SYS-\n"
+"    TIME.  So signals are sent and termination is\n"
+"    noticed within milliseconds.  If the kernel\n"
+"    lacks pidfd_open (Linux before 5.3), epm_sand-\n"
+"    box instead polls the USERTIME and SYSTIME and\n"
+"    checks for termination every 0.5 seconds.\n"
 ;
 
 void errno_exit ( char * m )
@@ -250,6 +396,749 @@ rlim_t processes = RLIM_INFINITY;
 int SIG = 0;	// SIG of -SIG... T; 0 if none.
 double T = 0;	// T of -SIG... T.
 
+double walltime = 0;
+    /* W of -walltime W; 0 if none. */
+double idle = 0;
+    /* I of -idle I; 0 if none. */
+double start_time;
+    /* CLOCK_MONOTONIC time the child was forked. */
+double last_cpu = -1;
+    /* Child CPU time when last seen to increase, */
+double last_progress;
+    /* and the CLOCK_MONOTONIC time then. */
+char killed_state = 0;
+    /* `W' or `I' if the child was killed for
+     * -walltime or -idle. */
+
+cpu_set_t cpus;
+    /* CPUs the child may run on. */
+int cpus_given = 0;
+    /* Set if -cpus or -numa restricts cpus. */
+int numa_node = -1;
+    /* NODE of -numa NODE; -1 if none. */
+#define NUMA_MASK_LONGS 16
+#define MAX_NUMA_NODES \
+    ( NUMA_MASK_LONGS * 8 * sizeof ( long ) )
+    /* Size of the set_mempolicy node mask. */
+int sched_policy = -1;
+    /* -sched policy; -1 if none. */
+char cpus_field[5000];
+    /* CPUS for STATUS-FILE. */
+
+rlim_t memory = RLIM_INFINITY;
+    /* -memory limit. */
+const char * cgroup_parent = NULL;
+    /* DIR of -cgroup DIR; NULL if none. */
+int cgroup_parent_fd = -1;
+    /* Descriptor of cgroup_parent. */
+char cgroup_name[100];
+int cgroup_fd = -1;
+    /* Name in cgroup_parent and descriptor of the
+     * cgroup created for the child. */
+pid_t cgroup_owner = 0;
+    /* Process that created the cgroup and must
+     * remove it; 0 once it is being removed. */
+int oom_killed = 0;
+    /* Set if a process of the child's cgroup was
+     * killed for exceeding -memory. */
+
+/* Write value to the file of the child's cgroup.
+ * Return 0 if this fails, with errno set.
+ */
+int cgroup_write ( const char * file, const char * value )
+{
+    int fd = openat ( cgroup_fd, file, O_WRONLY );
+    if ( fd < 0 ) return 0;
+    int ok = ( write ( fd, value, strlen ( value ) )
+               >= 0 );
+    int saved_errno = errno;
+    close ( fd );
+    errno = saved_errno;
+    return ok;
+}
+
+/* Read the file of the child's cgroup into buffer
+ * of the given size.  Return 0 if this fails.
+ */
+int cgroup_read ( const char * file,
+                  char * buffer, int size )
+{
+    int fd = openat ( cgroup_fd, file, O_RDONLY );
+    if ( fd < 0 ) return 0;
+    ssize_t s = read ( fd, buffer, size - 1 );
+    close ( fd );
+    if ( s < 0 ) return 0;
+    buffer[s] = 0;
+    return 1;
+}
+
+/* Return the value of the `KEY VALUE' line with the
+ * given key in buffer, or -1 if none.
+ */
+long long cgroup_value ( const char * buffer,
+                         const char * key )
+{
+    int n = strlen ( key );
+    const char * p = buffer;
+    while ( * p )
+    {
+        if ( strncmp ( p, key, n ) == 0
+	     &&
+	     p[n] == ' ' )
+	    return strtoll ( p + n + 1, NULL, 10 );
+	p = strchr ( p, '\n' );
+	if ( p == NULL ) break;
+	++ p;
+    }
+    return -1;
+}
+
+/* Create the child's cgroup in cgroup_parent and
+ * set its limits.
+ */
+void cgroup_create ( void )
+{
+    /* Open DIR as the real user, and check that it
+     * is a cgroup v2 directory delegated to that
+     * user, before creating anything in it as root.
+     */
+    if ( euid == 0
+	 &&
+	 seteuid ( ruid ) < 0 )
+	errno_exit
+	    ( "set euid to ruid"
+	      " before opening -cgroup DIR" );
+    cgroup_parent_fd =
+        open ( cgroup_parent,
+	       O_RDONLY|O_DIRECTORY|O_CLOEXEC );
+    int saved_errno = errno;
+    if ( euid == 0
+	 &&
+	 seteuid ( 0 ) < 0 )
+	errno_exit
+	    ( "set euid to root uid"
+	      " after opening -cgroup DIR" );
+    errno = saved_errno;
+    if ( cgroup_parent_fd < 0 )
+        errno_exit ( "opening -cgroup DIR" );
+
+    struct statfs fs;
+    struct stat st;
+    if ( fstatfs ( cgroup_parent_fd, & fs ) < 0
+         ||
+	 fstat ( cgroup_parent_fd, & st ) < 0 )
+        errno_exit ( "checking -cgroup DIR" );
+    if ( fs.f_type != CGROUP2_SUPER_MAGIC )
+    {
+	fprintf ( stderr,
+		  "epm_sandbox: -cgroup %s is not a"
+		  " cgroup v2 directory\n",
+		  cgroup_parent );
+	exit (1);
+    }
+    if ( st.st_uid != ruid )
+    {
+	fprintf ( stderr,
+		  "epm_sandbox: -cgroup %s is not"
+		  " owned by uid %d\n",
+		  cgroup_parent, (int) ruid );
+	exit (1);
+    }
+
+    sprintf ( cgroup_name, "epm_sandbox.%d",
+              (int) getpid() );
+    if ( mkdirat ( cgroup_parent_fd, cgroup_name,
+                   0755 ) < 0 )
+        errno_exit ( "creating cgroup" );
+    cgroup_fd = openat ( cgroup_parent_fd, cgroup_name,
+                           O_RDONLY|O_DIRECTORY
+			 | O_NOFOLLOW|O_CLOEXEC );
+    if ( cgroup_fd < 0 )
+    {
+	saved_errno = errno;
+	unlinkat ( cgroup_parent_fd, cgroup_name,
+	           AT_REMOVEDIR );
+	errno = saved_errno;
+        errno_exit ( "opening cgroup" );
+    }
+
+    char value[100];
+    if ( memory != RLIM_INFINITY )
+    {
+        sprintf ( value, "%lu",
+	          (unsigned long) memory );
+	if ( ! cgroup_write ( "memory.max", value ) )
+	{
+	    /* Fails if the memory controller is not
+	     * enabled. */
+	    saved_errno = errno;
+	    unlinkat ( cgroup_parent_fd, cgroup_name,
+	               AT_REMOVEDIR );
+	    errno = saved_errno;
+	    errno_exit ( "writing cgroup memory.max" );
+	}
+	cgroup_write ( "memory.swap.max", "0" );
+    }
+    if ( processes != RLIM_INFINITY )
+    {
+        sprintf ( value, "%lu",
+	          (unsigned long) processes );
+	if ( ! cgroup_write ( "pids.max", value )
+	     &&
+	     errno != ENOENT )
+	{
+	    saved_errno = errno;
+	    unlinkat ( cgroup_parent_fd, cgroup_name,
+	               AT_REMOVEDIR );
+	    errno = saved_errno;
+	    errno_exit ( "writing cgroup pids.max" );
+	}
+    }
+}
+
+/* Read the final CPU times and peak memory of the
+ * child's cgroup, replacing the values from getrus-
+ * age if they can be read, and set oom_killed.
+ */
+void cgroup_account
+	( double * USERTIME, double * SYSTIME,
+	  long * MAXRSS )
+{
+    char buffer[4000];
+    if ( cgroup_read ( "cpu.stat", buffer,
+                       sizeof ( buffer ) ) )
+    {
+	long long user =
+	    cgroup_value ( buffer, "user_usec" );
+	long long system =
+	    cgroup_value ( buffer, "system_usec" );
+	if ( user >= 0 && system >= 0 )
+	{
+	    * USERTIME = 1e-6 * user;
+	    * SYSTIME = 1e-6 * system;
+	}
+    }
+    if ( cgroup_read ( "memory.peak", buffer,
+                       sizeof ( buffer ) ) )
+	* MAXRSS = strtoll ( buffer, NULL, 10 ) / 1024;
+    if ( cgroup_read ( "memory.events", buffer,
+                       sizeof ( buffer ) ) )
+	oom_killed =
+	    ( cgroup_value ( buffer, "oom_kill" ) > 0 );
+}
+
+/* Kill any processes left in the child's cgroup and
+ * remove it.
+ */
+void cgroup_remove ( void )
+{
+    cgroup_owner = 0;
+    if ( euid == 0
+	 &&
+	 seteuid ( 0 ) < 0 )
+	errno_exit
+	    ( "set euid to root uid"
+	      " before removing cgroup" );
+    cgroup_write ( "cgroup.kill", "1" );
+    close ( cgroup_fd );
+    int tries;
+    for ( tries = 0; tries < 100; ++ tries )
+    {
+        if ( unlinkat ( cgroup_parent_fd, cgroup_name,
+	                AT_REMOVEDIR ) == 0 )
+	    break;
+	if ( errno != EBUSY )
+	    errno_exit ( "removing cgroup" );
+	usleep ( 10000 );
+	    /* Killed processes take time to leave the
+	     * cgroup. */
+    }
+    if ( tries == 100 )
+        errno_exit ( "removing cgroup" );
+    if ( euid == 0
+	 &&
+	 seteuid ( ruid ) < 0 )
+	errno_exit
+	    ( "set euid to ruid"
+	      " after removing cgroup" );
+}
+
+/* Exit handler: remove the child's cgroup if this
+ * process created it and is exiting on an error
+ * before main removes it.  Does nothing in the
+ * child, which shares the exit handlers until it
+ * executes the program.
+ */
+void cgroup_cleanup ( void )
+{
+    if ( cgroup_owner == getpid() )
+        cgroup_remove();
+}
+
+/* Read the child's user and system CPU times from
+ * child_stat_fd.  Return 0 if they could not be
+ * read, as when the child has terminated.
+ */
+int read_child_times
+	( double * USERTIME, double * SYSTIME )
+{
+    lseek ( child_stat_fd, 0, SEEK_SET );
+    ssize_t s = read ( child_stat_fd, child_stat,
+		       sizeof ( child_stat ) - 1 );
+    if ( s < 0 ) return 0;
+    child_stat[s] = 0;
+
+    char * p = child_stat;
+
+    /* Skip to field 14.
+     */
+    while ( * p != ')' && * p ) ++ p;
+    int i;
+    for ( i = 1; i <= 12; ++ i )
+    {
+	while ( * p && ! isspace ( * p ) ) ++ p;
+	while ( isspace ( * p ) ) ++ p;
+    }
+    while ( isspace ( * p ) ) ++ p;
+    if ( * p == 0 ) return 0;
+
+    /* Read user and system times.
+     */
+    char * endp;
+    double utime = sec_per_tick
+		 * strtol ( p, & endp, 10 );
+    if ( ! isspace ( * endp ) ) return 0;
+    p = endp;
+    while ( isspace ( * p ) ) ++ p;
+    double stime = sec_per_tick
+		 * strtol ( p, & endp, 10 );
+    if ( ! isspace ( * endp ) ) return 0;
+
+    * USERTIME = utime;
+    * SYSTIME = stime;
+    return 1;
+}
+
+/* Return the CLOCK_MONOTONIC time in seconds.
+ */
+double monotonic_now ( void )
+{
+    struct timespec t;
+    clock_gettime ( CLOCK_MONOTONIC, & t );
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/* Send signal to the child.
+ */
+void send_signal ( int signal )
+{
+    if ( euid == 0
+	 &&
+	 seteuid ( 0 ) < 0 )
+	errno_exit
+	    ( "set euid to root uid"
+	      " before kill" );
+    if ( kill ( child, signal ) < 0 )
+	errno_exit
+	    ( "kill sending signal to child" );
+    if ( euid == 0
+	 &&
+	 seteuid ( ruid ) < 0 )
+	errno_exit
+	    ( "set euid to ruid"
+	      " after kill" );
+}
+
+/* Given the child's current CPU time, kill the child
+ * and set killed_state if -walltime or -idle is
+ * exceeded.  With -cgroup the CPU time of the whole
+ * cgroup is used instead, so -idle does not kill a
+ * wrapper whose descendants are busy.
+ */
+void check_progress ( double cpu )
+{
+    char buffer[4000];
+    if ( idle > 0 && cgroup_fd >= 0
+         &&
+	 cgroup_read ( "cpu.stat", buffer,
+	               sizeof ( buffer ) ) )
+    {
+        long long usage =
+	    cgroup_value ( buffer, "usage_usec" );
+	if ( usage >= 0 ) cpu = 1e-6 * usage;
+    }
+
+    double now = monotonic_now();
+    if ( cpu > last_cpu )
+    {
+        last_cpu = cpu;
+	last_progress = now;
+    }
+    if ( killed_state != 0 ) return;
+    if ( walltime > 0 && now - start_time >= walltime )
+        killed_state = 'W';
+    else if ( idle > 0 && now - last_progress >= idle )
+        killed_state = 'I';
+    else
+        return;
+    send_signal ( SIGKILL );
+}
+
+/* Return a file descriptor that becomes readable
+ * when the child terminates, or -1 if the kernel
+ * does not support this.
+ */
+int open_child_pidfd ( void )
+{
+#   ifdef SYS_pidfd_open
+	return syscall ( SYS_pidfd_open, child, 0 );
+#   else
+	return -1;
+#   endif
+}
+
+/* Create a timer that expires when the child has
+ * used T seconds of CPU time, and that is then read-
+ * able from the returned signalfd.  Return -1 if the
+ * timer cannot be created, e.g., if the child has
+ * already terminated.
+ */
+int open_SIG_timer ( void )
+{
+    sigset_t mask;
+    sigemptyset ( & mask );
+    sigaddset ( & mask, SIGRTMIN );
+    if ( sigprocmask ( SIG_BLOCK, & mask, NULL ) < 0 )
+        errno_exit ( "sigprocmask SIGRTMIN" );
+
+    clockid_t clock;
+    if ( clock_getcpuclockid ( child, & clock ) != 0 )
+        return -1;
+
+    struct sigevent event;
+    memset ( & event, 0, sizeof ( event ) );
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGRTMIN;
+    timer_t timer;
+    if ( timer_create ( clock, & event, & timer ) < 0 )
+        return -1;
+
+    struct itimerspec value;
+    memset ( & value, 0, sizeof ( value ) );
+    value.it_value.tv_sec = (time_t) T;
+    value.it_value.tv_nsec =
+        (long) ( 1e9 * ( T - (time_t) T ) );
+    if ( timer_settime ( timer, 0, & value, NULL ) < 0 )
+        errno_exit ( "timer_settime" );
+
+    int fd = signalfd ( -1, & mask, SFD_CLOEXEC );
+    if ( fd < 0 ) errno_exit ( "signalfd" );
+    return fd;
+}
+
+/* Return a timerfd that first expires after first
+ * seconds and then every interval seconds (only once
+ * if interval is 0).
+ */
+int open_timer ( double first, double interval )
+{
+    int fd = timerfd_create
+        ( CLOCK_MONOTONIC, TFD_CLOEXEC );
+    if ( fd < 0 ) errno_exit ( "timerfd_create" );
+    struct itimerspec value;
+    value.it_value.tv_sec = (time_t) first;
+    value.it_value.tv_nsec =
+        (long) ( 1e9 * ( first - (time_t) first ) );
+    value.it_interval.tv_sec = (time_t) interval;
+    value.it_interval.tv_nsec =
+        (long) ( 1e9 * (   interval
+	                 - (time_t) interval ) );
+    if ( timerfd_settime ( fd, 0, & value, NULL ) < 0 )
+        errno_exit ( "timerfd_settime" );
+    return fd;
+}
+
+/* Set set to the CPUs in LIST.  Return 0 if LIST is
+ * malformed.
+ */
+int parse_cpu_list ( const char * list, cpu_set_t * set )
+{
+    CPU_ZERO ( set );
+    const char * p = list;
+    while ( 1 )
+    {
+	char * endp;
+	if ( ! isdigit ( * p ) ) return 0;
+	long first = strtol ( p, & endp, 10 );
+	long last = first;
+	p = endp;
+	if ( * p == '-' )
+	{
+	    ++ p;
+	    if ( ! isdigit ( * p ) ) return 0;
+	    last = strtol ( p, & endp, 10 );
+	    p = endp;
+	}
+	if ( last < first || last >= CPU_SETSIZE )
+	    return 0;
+	while ( first <= last )
+	    CPU_SET ( first ++, set );
+	if ( * p == 0 || * p == '\n' ) return 1;
+	if ( * p ++ != ',' ) return 0;
+    }
+}
+
+/* Set cpus_field to the CPUs in set, in -cpus LIST
+ * format.
+ */
+void format_cpu_list ( cpu_set_t * set )
+{
+    char * p = cpus_field;
+    int cpu = 0;
+    * p = 0;
+    while ( cpu < CPU_SETSIZE )
+    {
+        if ( ! CPU_ISSET ( cpu, set ) )
+	{
+	    ++ cpu;
+	    continue;
+	}
+	int last = cpu;
+	while ( last + 1 < CPU_SETSIZE
+	        &&
+		CPU_ISSET ( last + 1, set ) )
+	    ++ last;
+	if ( p != cpus_field ) * p ++ = ',';
+	if ( last == cpu )
+	    p += sprintf ( p, "%d", cpu );
+	else
+	    p += sprintf ( p, "%d-%d", cpu, last );
+	cpu = last + 1;
+    }
+    if ( p == cpus_field ) strcpy ( p, "none" );
+}
+
+/* Restrict the CPUs to those of numa_node, unless
+ * -cpus was given.
+ */
+void numa_cpus ( void )
+{
+    char fname[100];
+    sprintf ( fname,
+              "/sys/devices/system/node/node%d/cpulist",
+	      numa_node );
+    FILE * in = fopen ( fname, "r" );
+    char list[4000];
+    if ( in == NULL
+         ||
+	 fgets ( list, sizeof ( list ), in ) == NULL )
+    {
+	fprintf ( stderr,
+		  "epm_sandbox: cannot read CPUs of"
+		  " NUMA node %d\n", numa_node );
+	exit (1);
+    }
+    fclose ( in );
+    if ( ! parse_cpu_list ( list, & cpus ) )
+    {
+	fprintf ( stderr,
+		  "epm_sandbox: bad %s\n", fname );
+	exit (1);
+    }
+    cpus_given = 1;
+}
+
+/* Apply -cpus and -numa to the calling process (the
+ * child).
+ */
+void set_placement ( void )
+{
+    if ( cpus_given
+         &&
+	 sched_setaffinity ( 0, sizeof ( cpus ),
+	                     & cpus ) < 0 )
+	errno_exit ( "sched_setaffinity" );
+
+    if ( numa_node >= 0 )
+    {
+	unsigned long nodes[NUMA_MASK_LONGS];
+	memset ( nodes, 0, sizeof ( nodes ) );
+	int bits = 8 * sizeof ( long );
+	nodes[numa_node / bits] |=
+	    1UL << ( numa_node % bits );
+	if ( syscall ( SYS_set_mempolicy, MPOL_BIND,
+	               nodes, 8 * sizeof ( nodes ) )
+	     < 0 )
+	    errno_exit ( "set_mempolicy" );
+    }
+}
+
+/* Apply -sched to the calling process (the child),
+ * after its user ID and resource limits are set so
+ * that RLIMIT_RTPRIO applies.
+ */
+void set_scheduler ( void )
+{
+    if ( sched_policy == SCHED_FIFO
+         ||
+	 sched_policy == SCHED_RR )
+    {
+	struct rlimit limit;
+	limit.rlim_cur = ( cputime == RLIM_INFINITY ?
+	                   RLIM_INFINITY :
+			   cputime * 1000000 );
+	limit.rlim_max = limit.rlim_cur;
+	if ( setrlimit ( RLIMIT_RTTIME, & limit ) < 0 )
+	    errno_exit ( "setrlimit RLIMIT_RTTIME" );
+    }
+
+    if ( sched_policy >= 0 )
+    {
+	struct sched_param param;
+	param.sched_priority =
+	    sched_get_priority_min ( sched_policy );
+	if ( sched_setscheduler
+	         ( 0, sched_policy, & param ) < 0 )
+	    errno_exit ( "sched_setscheduler" );
+    }
+}
+
+/* -seccomp PROFILE.
+ */
+enum { SECCOMP_NONE, SECCOMP_JAVA, SECCOMP_PYTHON,
+       SECCOMP_C };
+int seccomp_profile = SECCOMP_NONE;
+
+#if defined ( __x86_64__ )
+#   define SECCOMP_ARCH AUDIT_ARCH_X86_64
+#elif defined ( __i386__ )
+#   define SECCOMP_ARCH AUDIT_ARCH_I386
+#elif defined ( __aarch64__ )
+#   define SECCOMP_ARCH AUDIT_ARCH_AARCH64
+#endif
+
+#ifdef SECCOMP_ARCH
+
+/* System calls forbidden by all profiles.
+ */
+int seccomp_forbidden[] = {
+    SYS_ptrace, SYS_process_vm_readv,
+    SYS_process_vm_writev, SYS_mount, SYS_umount2,
+    SYS_pivot_root, SYS_chroot, SYS_reboot,
+    SYS_kexec_load, SYS_init_module,
+    SYS_finit_module, SYS_delete_module,
+    SYS_swapon, SYS_swapoff, SYS_acct,
+    SYS_settimeofday, SYS_clock_settime,
+    SYS_sethostname, SYS_setdomainname,
+    SYS_quotactl, SYS_name_to_handle_at,
+    SYS_open_by_handle_at, SYS_fanotify_init,
+    SYS_unshare, SYS_setns, SYS_bpf,
+    SYS_perf_event_open, SYS_keyctl, SYS_add_key,
+    SYS_request_key, SYS_userfaultfd,
+    SYS_io_uring_setup, SYS_io_uring_enter,
+    SYS_io_uring_register,
+    -1 };
+
+#define CLONE_NEW_FLAGS \
+    ( CLONE_NEWNS | CLONE_NEWCGROUP | CLONE_NEWUTS \
+      | CLONE_NEWIPC | CLONE_NEWUSER | CLONE_NEWPID \
+      | CLONE_NEWNET )
+
+/* Install the filter for seccomp_profile in the
+ * calling process (the child).
+ */
+void install_seccomp ( void )
+{
+    struct sock_filter filter[128];
+    int n = 0;
+#   define STMT(code,k) \
+	filter[n++] = ( struct sock_filter ) \
+	    BPF_STMT ( code, k )
+#   define JUMP(code,k,jt,jf) \
+	filter[n++] = ( struct sock_filter ) \
+	    BPF_JUMP ( code, k, jt, jf )
+#   define KILL \
+	STMT ( BPF_RET|BPF_K, \
+	       SECCOMP_RET_KILL_PROCESS )
+#   define ALLOW \
+	STMT ( BPF_RET|BPF_K, SECCOMP_RET_ALLOW )
+#   define FORBID(nr) \
+	JUMP ( BPF_JMP|BPF_JEQ|BPF_K, nr, 0, 1 ); \
+	KILL
+
+    STMT ( BPF_LD|BPF_W|BPF_ABS,
+           offsetof ( struct seccomp_data, arch ) );
+    JUMP ( BPF_JMP|BPF_JEQ|BPF_K, SECCOMP_ARCH, 1, 0 );
+    KILL;
+    STMT ( BPF_LD|BPF_W|BPF_ABS,
+           offsetof ( struct seccomp_data, nr ) );
+#   ifdef __x86_64__
+	/* x32 system calls. */
+	JUMP ( BPF_JMP|BPF_JGE|BPF_K,
+	       0x40000000, 0, 1 );
+	KILL;
+#   endif
+
+    int i;
+    for ( i = 0; seccomp_forbidden[i] >= 0; ++ i )
+    {
+        FORBID ( seccomp_forbidden[i] );
+    }
+    if ( seccomp_profile >= SECCOMP_PYTHON )
+    {
+        FORBID ( SYS_socket );
+#	ifdef SYS_socketcall
+	    /* Multiplexes socket on i386. */
+	    FORBID ( SYS_socketcall );
+#	endif
+    }
+    if ( seccomp_profile >= SECCOMP_C )
+    {
+#	ifdef SYS_fork
+	    FORBID ( SYS_fork );
+#	endif
+#	ifdef SYS_vfork
+	    FORBID ( SYS_vfork );
+#	endif
+    }
+
+#   ifdef SYS_clone3
+	JUMP ( BPF_JMP|BPF_JEQ|BPF_K,
+	       SYS_clone3, 0, 1 );
+	STMT ( BPF_RET|BPF_K,
+	       SECCOMP_RET_ERRNO | ENOSYS );
+#   endif
+
+    /* clone: flags are the first argument.
+     */
+    JUMP ( BPF_JMP|BPF_JEQ|BPF_K, SYS_clone, 0, 4 );
+    STMT ( BPF_LD|BPF_W|BPF_ABS,
+           offsetof ( struct seccomp_data, args[0] ) );
+    JUMP ( BPF_JMP|BPF_JSET|BPF_K,
+           CLONE_NEW_FLAGS, 1, 0 );
+    JUMP ( BPF_JMP|BPF_JSET|BPF_K, CLONE_THREAD, 1,
+           seccomp_profile >= SECCOMP_C ? 0 : 1 );
+    KILL;
+    ALLOW;
+
+#   undef STMT
+#   undef JUMP
+#   undef KILL
+#   undef ALLOW
+#   undef FORBID
+
+    struct sock_fprog program;
+    program.len = n;
+    program.filter = filter;
+    if ( prctl ( PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0 ) < 0 )
+        errno_exit ( "prctl PR_SET_NO_NEW_PRIVS" );
+    if ( prctl ( PR_SET_SECCOMP, SECCOMP_MODE_FILTER,
+                 & program ) < 0 )
+        errno_exit ( "prctl PR_SET_SECCOMP" );
+}
+
+#endif /* SECCOMP_ARCH */
+
 /* Write status line into status_fd.
  */
 int status_fd;  /* status_file descriptor */
@@ -258,7 +1147,7 @@ int write_status
     ( char STATE, int EXITCODE, int SIGNAL,
       double USERTIME, double SYSTIME, long MAXRSS )
 {
-    char status_line[4000];
+    char status_line[10000];
     char * p = status_line;
     p += sprintf ( p, "%d %c %ld", COUNT, STATE,
                       (long) child );
@@ -313,9 +1202,9 @@ int write_status
 
     p += sprintf ( p, " %d %.6f", SIG, T );
 
-    p += sprintf ( p, " %d %d %.6f %.6f %lu %d\n",
+    p += sprintf ( p, " %d %d %.6f %.6f %lu %s %d\n",
                    EXITCODE, SIGNAL, USERTIME, SYSTIME,
-		   MAXRSS, COUNT );
+		   MAXRSS, cpus_field, COUNT );
     if ( ftruncate ( status_fd, 0 ) < 0 )
 	errno_exit ( "truncating STATUS-FILE" );
     if ( lseek ( status_fd, 0, SEEK_SET ) < 0 )
@@ -326,13 +1215,172 @@ int write_status
     ++ COUNT;
 }
 
+/* Information for REPORT-FILE.
+ */
+const char * report_file = NULL;
+int report_pipe[2];
+    /* The child waits for the parent to close this
+     * pipe before executing `program', so hardware
+     * counters can be opened first. */
+long long child_io[4] = { -1, -1, -1, -1 };
+    /* rchar, wchar, read_bytes, write_bytes from
+     * /proc/PID/io; -1 if not read. */
+int perf_fds[2] = { -1, -1 };
+    /* Counters of instructions and cycles. */
+
+/* Open the hardware counters for the child, which
+ * start counting when it executes `program'.  Coun-
+ * ters that cannot be opened are skipped.
+ */
+void open_perf_counters ( void )
+{
+    if ( euid == 0
+	 &&
+	 seteuid ( 0 ) < 0 )
+	errno_exit
+	    ( "set euid to root uid"
+	      " before perf_event_open" );
+    int i;
+    for ( i = 0; i < 2; ++ i )
+    {
+	struct perf_event_attr attr;
+	memset ( & attr, 0, sizeof ( attr ) );
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof ( attr );
+	attr.config = ( i == 0 ?
+	                PERF_COUNT_HW_INSTRUCTIONS :
+			PERF_COUNT_HW_CPU_CYCLES );
+	attr.disabled = 1;
+	attr.enable_on_exec = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	perf_fds[i] = syscall
+	    ( SYS_perf_event_open, & attr, child,
+	      -1, -1, PERF_FLAG_FD_CLOEXEC );
+    }
+    if ( euid == 0
+	 &&
+	 seteuid ( ruid ) < 0 )
+	errno_exit
+	    ( "set euid to ruid"
+	      " after perf_event_open" );
+}
+
+/* Read child_io from /proc/PID/io.  Must be called
+ * after the child terminates but before it is
+ * reaped.
+ */
+void read_child_io ( void )
+{
+    if ( euid == 0
+	 &&
+	 seteuid ( 0 ) < 0 )
+	errno_exit
+	    ( "set euid to root uid"
+	      " before reading /proc/PID/io" );
+    char fname[100];
+    sprintf ( fname, "/proc/%d/io", child );
+    int fd = open ( fname, O_RDONLY );
+    if ( fd >= 0 )
+    {
+	char buffer[1000];
+	ssize_t s = read ( fd, buffer,
+	                   sizeof ( buffer ) - 1 );
+	close ( fd );
+	if ( s > 0 )
+	{
+	    buffer[s] = 0;
+	    child_io[0] =
+	        cgroup_value ( buffer, "rchar:" );
+	    child_io[1] =
+	        cgroup_value ( buffer, "wchar:" );
+	    child_io[2] =
+	        cgroup_value ( buffer, "read_bytes:" );
+	    child_io[3] =
+	        cgroup_value ( buffer, "write_bytes:" );
+	}
+    }
+    if ( euid == 0
+	 &&
+	 seteuid ( ruid ) < 0 )
+	errno_exit
+	    ( "set euid to ruid"
+	      " after reading /proc/PID/io" );
+}
+
+/* Write report file, assuming it exists.
+ */
+void write_report
+	( double USERTIME, double SYSTIME,
+	  double WALLTIME, long MAXRSS,
+	  struct rusage * usage )
+{
+    int fd = open ( report_file,
+                    O_WRONLY|O_CREAT|O_TRUNC,
+		    0640 );
+    if ( fd < 0 ) errno_exit ( "opening REPORT-FILE" );
+    FILE * out = fdopen ( fd, "w" );
+    if ( out == NULL )
+        errno_exit ( "opening REPORT-FILE" );
+    fprintf ( out, "USERTIME %.6f\n", USERTIME );
+    fprintf ( out, "SYSTIME %.6f\n", SYSTIME );
+    fprintf ( out, "WALLTIME %.6f\n", WALLTIME );
+    fprintf ( out, "MAXRSS %ld\n", MAXRSS );
+    fprintf ( out, "MINFLT %ld\n", usage->ru_minflt );
+    fprintf ( out, "MAJFLT %ld\n", usage->ru_majflt );
+    fprintf ( out, "NVCSW %ld\n", usage->ru_nvcsw );
+    fprintf ( out, "NIVCSW %ld\n", usage->ru_nivcsw );
+    fprintf ( out, "INBLOCK %ld\n",
+                   usage->ru_inblock );
+    fprintf ( out, "OUBLOCK %ld\n",
+                   usage->ru_oublock );
+
+    const char * io_keys[4] =
+        { "RCHAR", "WCHAR",
+	  "READ_BYTES", "WRITE_BYTES" };
+    int i;
+    for ( i = 0; i < 4; ++ i )
+    {
+        if ( child_io[i] >= 0 )
+	    fprintf ( out, "%s %lld\n", io_keys[i],
+	                   child_io[i] );
+    }
+
+    const char * perf_keys[2] =
+        { "INSTRUCTIONS", "CYCLES" };
+    for ( i = 0; i < 2; ++ i )
+    {
+	unsigned long long count;
+        if ( perf_fds[i] >= 0
+	     &&
+	        read ( perf_fds[i], & count,
+	               sizeof ( count ) )
+	     == sizeof ( count ) )
+	    fprintf ( out, "%s %llu\n", perf_keys[i],
+	                   count );
+    }
+
+    if ( fclose ( out ) != 0 )
+	errno_exit ( "writing REPORT-FILE" );
+}
+
 /* Write score file, assuming it exists.
  */
 const char * score_file = NULL;
 int write_score ( char STATE, int EXITCODE, int SIGNAL )
 {
     char score[1000] = "Undefined Score";
-    if ( STATE == 'E' ) switch ( EXITCODE )
+    if ( STATE == 'W' )
+	sprintf ( score,
+	          "Wall Clock Time Limit (%.3f sec)"
+		  " Exceeded",
+		  walltime );
+    else if ( STATE == 'I' )
+	sprintf ( score,
+	          "Idle Time Limit (%.3f sec) Exceeded",
+		  idle );
+    else if ( STATE == 'E' ) switch ( EXITCODE )
     {
     case 1:
 	strcpy ( score,
@@ -363,6 +1411,10 @@ int write_score ( char STATE, int EXITCODE, int SIGNAL )
 	          "Command Failed with Exit Code %d",
 		  EXITCODE );
     }
+    else if ( SIGNAL == SIGKILL && oom_killed )
+	sprintf ( score,
+	          "Memory Limit (%.0f kb) Exceeded",
+		  (double) memory / 1024 );
     else switch ( SIGNAL )
     {
     case 24:
@@ -424,6 +1476,10 @@ int write_score ( char STATE, int EXITCODE, int SIGNAL )
 	strcpy ( score,
 	         "Terminated by Termination Signal" );
 	break;
+    case 31:
+	strcpy ( score,
+	         "Terminated by Forbidden System Call" );
+	break;
     default:
 	sprintf ( score,
 	         "Command Failed with Signal %d",
@@ -510,6 +1566,187 @@ int main ( int argc, char ** argv )
 	    score_file = argv[index++];
 	    continue;
 	}
+        else if ( strcmp ( argv[index], "-report" )
+	     == 0 )
+	{
+	    ++ index;
+	    if ( index >= argc )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: Too few"
+			  " arguments\n" );
+		exit (1);
+	    }
+	    report_file = argv[index++];
+	    continue;
+	}
+        else if ( strcmp ( argv[index], "-walltime" )
+	          == 0
+		  ||
+	          strcmp ( argv[index], "-idle" )
+		  == 0 )
+	{
+	    double * limit =
+	        ( argv[index][1] == 'w' ? & walltime
+		                        : & idle );
+	    ++ index;
+	    if ( index >= argc )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: Too few"
+			  " arguments\n" );
+		exit (1);
+	    }
+	    char * endp;
+	    * limit = strtod ( argv[index], & endp );
+	    if ( * endp != 0 || ! ( 0 < * limit ) )
+	        // In case * limit == NaN
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: bad %s argument"
+			  " %s\n", argv[index-1],
+			  argv[index] );
+		exit (1);
+	    }
+	    ++ index;
+	    continue;
+	}
+        else if ( strcmp ( argv[index], "-cpus" )
+	          == 0 )
+	{
+	    ++ index;
+	    if ( index >= argc )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: Too few"
+			  " arguments\n" );
+		exit (1);
+	    }
+	    if ( ! parse_cpu_list ( argv[index], & cpus )
+	         ||
+		 CPU_COUNT ( & cpus ) == 0 )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: bad -cpus"
+			  " argument %s\n",
+			  argv[index] );
+		exit (1);
+	    }
+	    cpus_given = 1;
+	    ++ index;
+	    continue;
+	}
+        else if ( strcmp ( argv[index], "-numa" )
+	          == 0 )
+	{
+	    ++ index;
+	    if ( index >= argc )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: Too few"
+			  " arguments\n" );
+		exit (1);
+	    }
+	    char * endp;
+	    long node =
+	        strtol ( argv[index], & endp, 10 );
+	    if ( ! isdigit ( argv[index][0] )
+	         || * endp != 0
+		 || node >= (long) MAX_NUMA_NODES )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: bad -numa"
+			  " argument %s\n",
+			  argv[index] );
+		exit (1);
+	    }
+	    numa_node = node;
+	    ++ index;
+	    continue;
+	}
+        else if ( strcmp ( argv[index], "-sched" )
+	          == 0 )
+	{
+	    ++ index;
+	    if ( index >= argc )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: Too few"
+			  " arguments\n" );
+		exit (1);
+	    }
+	    const char * policy = argv[index];
+	    if ( strcmp ( policy, "other" ) == 0 )
+	        sched_policy = SCHED_OTHER;
+	    else if ( strcmp ( policy, "batch" ) == 0 )
+	        sched_policy = SCHED_BATCH;
+	    else if ( strcmp ( policy, "idle" ) == 0 )
+	        sched_policy = SCHED_IDLE;
+	    else if ( strcmp ( policy, "fifo" ) == 0 )
+	        sched_policy = SCHED_FIFO;
+	    else if ( strcmp ( policy, "rr" ) == 0 )
+	        sched_policy = SCHED_RR;
+	    else
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: bad -sched"
+			  " argument %s\n",
+			  policy );
+		exit (1);
+	    }
+	    ++ index;
+	    continue;
+	}
+        else if ( strcmp ( argv[index], "-seccomp" )
+	          == 0 )
+	{
+	    ++ index;
+	    if ( index >= argc )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: Too few"
+			  " arguments\n" );
+		exit (1);
+	    }
+	    const char * profile = argv[index];
+	    if ( strcmp ( profile, "java" ) == 0 )
+	        seccomp_profile = SECCOMP_JAVA;
+	    else if ( strcmp ( profile, "python" ) == 0 )
+	        seccomp_profile = SECCOMP_PYTHON;
+	    else if ( strcmp ( profile, "c" ) == 0 )
+	        seccomp_profile = SECCOMP_C;
+	    else
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: bad -seccomp"
+			  " argument %s\n",
+			  profile );
+		exit (1);
+	    }
+#	    ifndef SECCOMP_ARCH
+		fprintf ( stderr,
+			  "epm_sandbox: -seccomp is"
+			  " not supported on this"
+			  " architecture\n" );
+		exit (1);
+#	    endif
+	    ++ index;
+	    continue;
+	}
+        else if ( strcmp ( argv[index], "-cgroup" )
+	     == 0 )
+	{
+	    ++ index;
+	    if ( index >= argc )
+	    {
+		fprintf ( stderr,
+			  "epm_sandbox: Too few"
+			  " arguments\n" );
+		exit (1);
+	    }
+	    cgroup_parent = argv[index++];
+	    continue;
+	}
         else if ( strcmp ( argv[index], "-env" )
 	     == 0 )
 	{
@@ -609,6 +1846,9 @@ int main ( int argc, char ** argv )
         else if ( strcmp ( argv[index], "-processes" )
 	     == 0 )
 	    option = & processes;
+        else if ( strcmp ( argv[index], "-memory" )
+	     == 0 )
+	    option = & memory;
         else break;
 
 	/* Come here to process numeric options. */
@@ -709,6 +1949,29 @@ int main ( int argc, char ** argv )
 	++ index;
     }
 
+    if ( memory != RLIM_INFINITY
+         &&
+	 cgroup_parent == NULL )
+    {
+	fprintf ( stderr,
+		  "epm_sandbox: -memory needs"
+		  " -cgroup\n" );
+	exit (1);
+    }
+
+    if ( numa_node >= 0 && ! cpus_given )
+        numa_cpus();
+    if ( cpus_given )
+        format_cpu_list ( & cpus );
+    else
+    {
+	cpu_set_t set;
+	if ( sched_getaffinity ( 0, sizeof ( set ),
+	                         & set ) < 0 )
+	    errno_exit ( "sched_getaffinity" );
+        format_cpu_list ( & set );
+    }
+
     if ( SIG > 0 && cputime == RLIM_INFINITY )
     {
         cputime = (rlim_t) ( T + 2 );
@@ -821,6 +2084,19 @@ int main ( int argc, char ** argv )
 		  program );
     }
 
+    if ( cgroup_parent != NULL )
+    {
+        cgroup_create();
+	cgroup_owner = getpid();
+	atexit ( cgroup_cleanup );
+    }
+
+    if ( report_file != NULL
+         &&
+	 pipe2 ( report_pipe, O_CLOEXEC ) < 0 )
+        errno_exit ( "pipe" );
+
+    start_time = last_progress = monotonic_now();
     child = fork ();
 
     if ( child < 0 )
@@ -852,6 +2128,13 @@ int main ( int argc, char ** argv )
 		   r, e, s );
 	}
 
+	if ( report_file != NULL )
+	{
+	    open_perf_counters();
+	    close ( report_pipe[0] );
+	    close ( report_pipe[1] );
+	}
+
 	if ( status_file != NULL )
 	{
 	    status_fd =
@@ -868,7 +2151,8 @@ int main ( int argc, char ** argv )
 	else
 	    status_fd = -1;
 
-	if ( SIG > 0 || status_file != NULL )
+	if (    SIG > 0 || status_file != NULL
+	     || walltime > 0 || idle > 0 )
 	{
 	    char fname[100];
 	    sprintf ( fname, "/proc/%d/stat", child );
@@ -891,53 +2175,162 @@ int main ( int argc, char ** argv )
 	int saved_errno;
 	int sig_sent = 0;
 
-	if ( child_stat_fd >= 0 ) while ( 1 )
+	double tick = 0.5;
+	    /* Interval for rewriting STATUS-FILE and
+	     * checking -idle. */
+	if ( idle > 0 && idle / 4 < tick )
+	    tick = idle / 4;
+
+	int pidfd = ( child_stat_fd >= 0 ?
+	              open_child_pidfd() : -1 );
+
+	if ( pidfd >= 0 )
 	{
-	    usleep ( 500000 ); /* 0.5 seconds */
+	    /* Wait for child termination, SIG timer
+	     * expiration, walltime timer expiration,
+	     * or status timer expiration.
+	     */
+	    struct pollfd fds[4];
+	    int nfds = 0;
+	    fds[nfds].fd = pidfd;
+	    fds[nfds++].events = POLLIN;
+	    int sig_fd = ( SIG > 0 ? open_SIG_timer()
+	                           : -1 );
+	    int sig_index = -1;
+	    if ( sig_fd >= 0 )
+	    {
+	        sig_index = nfds;
+		fds[nfds].fd = sig_fd;
+		fds[nfds++].events = POLLIN;
+	    }
+	    int wall_fd = -1;
+	    int wall_index = -1;
+	    if ( walltime > 0 )
+	    {
+	        wall_fd = open_timer ( walltime, 0 );
+	        wall_index = nfds;
+		fds[nfds].fd = wall_fd;
+		fds[nfds++].events = POLLIN;
+	    }
+	    /* If the SIG timer could not be created,
+	     * the status timer is also used to poll
+	     * for T.
+	     */
+	    int status_timer_fd = -1;
+	    int status_index = -1;
+	    if ( status_fd >= 0 || idle > 0
+	         ||
+		 ( SIG > 0 && sig_fd < 0 ) )
+	    {
+		status_timer_fd =
+		    open_timer ( tick, tick );
+	        status_index = nfds;
+		fds[nfds].fd = status_timer_fd;
+		fds[nfds++].events = POLLIN;
+	    }
+
+	    while ( 1 )
+	    {
+		if ( poll ( fds, nfds, -1 ) < 0 )
+		{
+		    if ( errno == EINTR ) continue;
+		    errno_exit ( "poll" );
+		}
+		if ( fds[0].revents != 0 ) break;
+
+		if ( sig_index >= 0
+		     &&
+		     fds[sig_index].revents != 0 )
+		{
+		    struct signalfd_siginfo info;
+		    if ( read ( sig_fd, & info,
+		                sizeof ( info ) ) < 0 )
+		        errno_exit
+			    ( "reading signalfd" );
+		    if ( ! sig_sent ) send_signal ( SIG );
+		    sig_sent = 1;
+		}
+
+		if ( wall_index >= 0
+		     &&
+		     fds[wall_index].revents != 0 )
+		{
+		    unsigned long long expirations;
+		    if ( read ( wall_fd, & expirations,
+				sizeof ( expirations ) )
+			 < 0 )
+		        errno_exit
+			    ( "reading timerfd" );
+		    check_progress ( last_cpu );
+		}
+
+		if ( status_index >= 0
+		     &&
+		     fds[status_index].revents != 0 )
+		{
+		    unsigned long long expirations;
+		    if ( read ( status_timer_fd,
+				& expirations,
+				sizeof ( expirations ) )
+			 < 0 )
+		        errno_exit
+			    ( "reading timerfd" );
+		    if ( ! read_child_times
+		             ( & USERTIME, & SYSTIME ) )
+		        continue;
+		    if ( status_fd >= 0 )
+			write_status
+			    ( STATE, EXITCODE, SIGNAL,
+			      USERTIME, SYSTIME,
+			      MAXRSS );
+		    if ( SIG > 0 && sig_fd < 0
+		         && USERTIME + SYSTIME > T
+			 && ! sig_sent )
+		    {
+			send_signal ( SIG );
+			sig_sent = 1;
+		    }
+		    check_progress ( USERTIME + SYSTIME );
+		}
+	    }
+	    if ( report_file != NULL )
+	        read_child_io();
+	    r = waitpid ( child, & status, 0 );
+	    saved_errno = errno;
 
-	    lseek ( child_stat_fd, 0, SEEK_SET );
-	    ssize_t s = read ( child_stat_fd,
-	                       child_stat,
-			       sizeof ( child_stat )
-			           - 1 );
-	    if ( s >= 0 ) child_stat[s] = 0;
+	    close ( pidfd );
+	    if ( sig_fd >= 0 ) close ( sig_fd );
+	    if ( wall_fd >= 0 ) close ( wall_fd );
+	    if ( status_timer_fd >= 0 )
+	        close ( status_timer_fd );
+	}
+	else if ( child_stat_fd >= 0 ) while ( 1 )
+	{
+	    usleep ( (useconds_t) ( 1e6 * tick ) );
 
 	    /* child_stat_fd may or may not remain open
 	     * and readable after process dies, so we
 	     * ignore errors in reading it and use
 	     * waitpid to see if child has died.
 	     */
+	    int s = read_child_times
+	                ( & USERTIME, & SYSTIME );
 
+	    if ( report_file != NULL )
+	    {
+	        siginfo_t info;
+		info.si_pid = 0;
+		if ( waitid ( P_PID, child, & info,
+		                WEXITED|WNOHANG
+			      | WNOWAIT ) == 0
+		     &&
+		     info.si_pid != 0 )
+		    read_child_io();
+	    }
 	    r = waitpid ( child, & status, WNOHANG );
 	    saved_errno = errno;
 	    if ( r != 0 ) break;
-	    if ( s < 0 ) continue;
-
-	    char * p = child_stat;
-
-	    /* Skip to field 14.
-	     */
-	    while ( * p != ')' && * p ) ++ p;
-	    int i;
-	    for ( i = 1; i <= 12; ++ i )
-	    {
-		while ( * p && ! isspace ( * p ) ) ++ p;
-	        while ( isspace ( * p ) ) ++ p;
-	    }
-	    while ( isspace ( * p ) ) ++ p;
-	    if ( * p == 0 ) continue;
-
-	    /* Read user and system times.
-	     */
-	    char * endp;
-	    USERTIME = sec_per_tick
-	             * strtol ( p, & endp, 10 );
-	    if ( ! isspace ( * endp ) ) continue;
-	    p = endp;
-	    while ( isspace ( * p ) ) ++ p;
-	    SYSTIME = sec_per_tick
-	            * strtol ( p, & endp, 10 );
-	    if ( ! isspace ( * endp ) ) continue;
+	    if ( ! s ) continue;
 
 	    if ( status_fd >= 0 )
 		write_status ( STATE, EXITCODE, SIGNAL,
@@ -946,26 +2339,23 @@ int main ( int argc, char ** argv )
 	    if ( SIG > 0 && USERTIME + SYSTIME > T
 	    		 && ! sig_sent )
 	    {
-		if ( euid == 0
-		     &&
-		     seteuid ( 0 ) < 0 )
-		    errno_exit
-		        ( "set euid to root uid"
-			  " before kill" );
-		if ( kill ( child, SIG ) < 0 )
-		    errno_exit
-			( "kill sending SIG to child" );
-		if ( euid == 0
-		     &&
-		     seteuid ( ruid ) < 0 )
-		    errno_exit
-		        ( "set euid to ruid"
-			  " after kill" );
-	        sig_sent = 0;
+		send_signal ( SIG );
+	        sig_sent = 1;
 	    }
+	    check_progress ( USERTIME + SYSTIME );
 	}
 	else
+	{
+	    if ( report_file != NULL )
+	    {
+	        siginfo_t info;
+		if ( waitid ( P_PID, child, & info,
+		              WEXITED|WNOWAIT ) == 0 )
+		    read_child_io();
+	    }
 	    r = waitpid ( child, & status, 0 );
+	}
+	double WALLTIME = monotonic_now() - start_time;
 
 	if ( child_stat_fd >= 0 )
 	    close ( child_stat_fd );
@@ -983,6 +2373,13 @@ int main ( int argc, char ** argv )
 		+ 1e-6 * usage.ru_stime.tv_usec;
 	MAXRSS = usage.ru_maxrss;
 
+	if ( cgroup_parent != NULL )
+	{
+	    cgroup_account
+	        ( & USERTIME, & SYSTIME, & MAXRSS );
+	    cgroup_remove();
+	}
+
 	if ( r >= 0 )
 	{
 	    signaled = WIFSIGNALED ( status );
@@ -1014,6 +2411,11 @@ int main ( int argc, char ** argv )
 		signaled = 1;
 	    }
 	    STATE = ( signaled ? 'S' : 'E' );
+	    if ( signaled && killed_state != 0 )
+	    {
+		STATE = killed_state;
+		SIGNAL = SIGKILL;
+	    }
 	}
 	else if ( r < 0 )
 	{
@@ -1032,6 +2434,10 @@ int main ( int argc, char ** argv )
 	    errno_exit ( "wait" );
 	}
 
+	if ( report_file != NULL )
+	    write_report ( USERTIME, SYSTIME, WALLTIME,
+	                   MAXRSS, & usage );
+
 	if ( status_fd >= 0 )
 	{
 	    if ( close ( status_fd ) < 0 )
@@ -1039,6 +2445,12 @@ int main ( int argc, char ** argv )
 		    ( "closing STATUS-FILE" );
 
 	}
+	else if ( STATE == 'W' || STATE == 'I' )
+	    fprintf ( stderr,
+		      "epm_sandbox: Child killed:"
+		      " %s time limit exceeded\n",
+		      STATE == 'W' ? "wall clock"
+		                   : "idle" );
 	else if ( signaled )
 	    fprintf ( stderr,
 		      "epm_sandbox: Child"
@@ -1048,7 +2460,8 @@ int main ( int argc, char ** argv )
 
 	if ( score_file != NULL
 	     &&
-	     ( STATE == 'S' || EXITCODE != 0 ) )
+	     (    STATE == 'S' || STATE == 'W'
+	       || STATE == 'I' || EXITCODE != 0 ) )
 	{
 	    write_score ( STATE, EXITCODE, SIGNAL );
 	    exit ( 119 );
@@ -1063,6 +2476,25 @@ int main ( int argc, char ** argv )
     /* Child continues execution here.
     */
 
+    if ( report_file != NULL )
+    {
+        /* Wait for the parent to open the hardware
+	 * counters. */
+	char c;
+	close ( report_pipe[1] );
+	while ( read ( report_pipe[0], & c, 1 ) < 0
+	        &&
+		errno == EINTR );
+	close ( report_pipe[0] );
+    }
+
+    if ( cgroup_parent != NULL
+         &&
+	 ! cgroup_write ( "cgroup.procs", "0" ) )
+        errno_exit ( "moving child into cgroup" );
+
+    set_placement();
+
     if ( euid == 0 ) {
 
         /* Execute if effective user is root. */
@@ -1190,6 +2622,8 @@ int main ( int argc, char ** argv )
 #	endif
     }
 
+    set_scheduler();
+
     /* For some reason the kernel claims that SIGXFSZ
      * is set to default action but it behaves instead
      * like ignore action unless we explicitly set it
@@ -1209,6 +2643,11 @@ int main ( int argc, char ** argv )
 	    errno_exit ( "sigaction SIGXFSZ ..." );
     }
 
+#   ifdef SECCOMP_ARCH
+	if ( seccomp_profile != SECCOMP_NONE )
+	    install_seccomp();
+#   endif
+
     /* Execute program with arguments and optional
        environment.
     */
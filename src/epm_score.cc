@@ -16,28 +16,130 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
-#include <cctype>
 #include <cstring>
 #include <cmath>
+#include <cfloat>
 #include <cstdarg>
 #include <cassert>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#if defined ( __AVX2__ )
+#   include <immintrin.h>
+#elif defined ( __SSE2__ )
+#   include <emmintrin.h>
+#endif
+extern "C" {
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <zlib.h>
+#ifdef EPM_ZSTD
+#   include <zstd.h>
+#endif
+}
 using std::cin;
 using std::cout;
 using std::cerr;
 using std::endl;
 using std::string;
 using std::vector;
+using std::ostream;
 using std::ifstream;
+using std::ofstream;
+using std::istringstream;
+using std::ostringstream;
 using std::max;
+using std::reverse;
 using std::isnan;
+using std::isinf;
 
 unsigned const LIMIT = 5;
 char const ILLEGAL = '?';
     // May not be space character.
 
+// Character classes.  These replace <cctype>, whose
+// functions depend on the locale and are undefined
+// for negative char values, i.e., for the non-ASCII
+// bytes of UTF-8 encodings when char is signed.
+//
+enum {
+    CLASS_SPACE		= 1 << 0,
+        // Space, \t, \n, \v, \f, \r, as isspace.
+    CLASS_LETTER	= 1 << 1,
+        // ASCII letter.
+    CLASS_DIGIT		= 1 << 2,
+    CLASS_NON_ASCII	= 1 << 3,
+        // Byte of a UTF-8 encoding of a non-ASCII
+	// character.
+    CLASS_BLANK		= 1 << 4,
+        // Space, \t, \n, \r: allowed in blank lines.
+    CLASS_ILLEGAL	= 1 << 5,
+        // Other ASCII control characters and DEL,
+	// replaced by ILLEGAL in lines.
+    CLASS_WORD		= CLASS_LETTER | CLASS_NON_ASCII
+        // Characters of WORD tokens.
+};
+
+// Table of the classes of each byte.  Characters
+// with class 0 are separator characters.
+//
+struct char_class_table
+{
+    unsigned char classes[256];
+
+    constexpr char_class_table ( void ) : classes()
+    {
+	for ( int c = 0; c < 256; ++ c )
+	{
+	    unsigned char & k = classes[c];
+	    if ( c >= 0200 )
+	        k = CLASS_NON_ASCII;
+	    else if ( ( 'a' <= c && c <= 'z' )
+	              ||
+		      ( 'A' <= c && c <= 'Z' ) )
+	        k = CLASS_LETTER;
+	    else if ( '0' <= c && c <= '9' )
+	        k = CLASS_DIGIT;
+	    else if (    c == ' ' || c == '\t'
+	              || c == '\n' || c == '\r' )
+	        k = CLASS_SPACE | CLASS_BLANK;
+	    else if ( c == '\v' || c == '\f' )
+	        k = CLASS_SPACE | CLASS_ILLEGAL;
+	    else if ( c < ' ' || c > '~' )
+	        k = CLASS_ILLEGAL;
+	}
+    }
+};
+constexpr char_class_table char_classes;
+
+inline unsigned char_class ( char c )
+{
+    return char_classes.classes[(unsigned char) c];
+}
+inline bool is_space ( char c )
+{
+    return char_class ( c ) & CLASS_SPACE;
+}
+inline bool is_letter ( char c )
+{
+    return char_class ( c ) & CLASS_LETTER;
+}
+inline bool is_digit ( char c )
+{
+    return char_class ( c ) & CLASS_DIGIT;
+}
+
 char documentation [] =
 "epm_score [options] output_file test_file\n"
+"epm_score [options] -batch manifest\n"
 "\n"
 "    The output_file is the submitted solution's\n"
 "    output and the test_file is the judge's\n"
@@ -46,6 +148,23 @@ char documentation [] =
 "    lines that begin with `!!' and are skipped and\n"
 "    thus ignored by epm_score.\n"
 "\n"
+"    The output_file may be `-' to read the standard\n"
+"    input, or /dev/fd/N to read inherited file de-\n"
+"    scriptor N, e.g., a pipe from the program that\n"
+"    writes the output.  The output is then scored\n"
+"    as it is written.  If scoring ends before the\n"
+"    end of the output (because of -early, the error\n"
+"    type limit, or superfluous lines at the end of\n"
+"    the output), the pipe is closed at once, so its\n"
+"    writer gets SIGPIPE if it writes more.\n"
+"\n"
+"    Either file may be gzip compressed, or zstd\n"
+"    compressed if epm_score was compiled with\n"
+"    -DEPM_ZSTD; it is decompressed as it is read.\n"
+"    Corrupt or truncated compressed data, or a\n"
+"    read error, is reported like an unreadable\n"
+"    file instead of a score.\n"
+"\n"
 "    This program outputs a summary score line, fol-\n"
 "    lowed by descriptions of any errors found in the\n"
 "    output_file by comparing it to the test_file.\n"
@@ -236,6 +355,119 @@ char documentation [] =
 "        of a character, tabs are set every 8 col-\n"
 "        umns.\n"
 "\n"
+"    -early\n"
+"        Stop scoring as soon as the summary score is\n"
+"        `Incorrect Output' and L error types have\n"
+"        been found, as no more errors can change the\n"
+"        summary score or be described.  This is\n"
+"        reported as `Scoring Stopped Early At:' fol-\n"
+"        lowed by the current lines, and the error\n"
+"        counts are those found before stopping.\n"
+"\n"
+"    -diff D\n"
+"        If the summary score is `Incomplete Output'\n"
+"        or `Incorrect Output', read the files again\n"
+"        and find the fewest lines to delete from or\n"
+"        insert into the output to make it match the\n"
+"        test file, provided at most D (1 <= D <=\n"
+"        2000) lines are to be deleted or inserted.\n"
+"        Two lines match if their tokens are equal\n"
+"        as character strings, ignoring letter case\n"
+"        as the above errors do; numbers are not\n"
+"        compared as numbers.  Blank lines are ig-\n"
+"        nored unless -blank is given.  This is re-\n"
+"        ported after the error descriptions as the\n"
+"        number of matching lines and each group of\n"
+"        extra, missing, or differing lines (or that\n"
+"        there are more than D after the matching\n"
+"        lines at the beginning of the files), so\n"
+"        scoring can resynchronize after an extra or\n"
+"        missing line.  Not done if the output is a\n"
+"        pipe.\n"
+"\n"
+"    -json\n"
+"        Instead of the above, output one line con-\n"
+"        taining a JSON object with the members:\n"
+"\n"
+"          score: the summary score\n"
+"          gave_up, stopped: true if more than L\n"
+"            error types were found, or -early\n"
+"            stopped scoring\n"
+"          stopped_at: if either is true, the\n"
+"            output_line and test_line numbers\n"
+"          errors: array with one object per error\n"
+"            type with members type, severity,\n"
+"            count, and first, which describes the\n"
+"            first instance by its output and test\n"
+"            line, token end column, and token, and\n"
+"            its message\n"
+"          float_comparisons, max_A, max_R: as in\n"
+"            the text output (null if not relevant)\n"
+"          illegal: output and test illegal char-\n"
+"            acter count and first_line\n"
+"          diff: for -diff, output_lines, test_\n"
+"            lines, matching, exceeded, and the\n"
+"            differences as objects with output_\n"
+"            line, output_count, test_line, and\n"
+"            test_count\n"
+"          elapsed: scoring time in seconds\n"
+"          bytes: bytes of both files scanned\n"
+"\n"
+"        If a file is not readable the object has\n"
+"        just an error member.\n"
+"\n"
+"    -stats\n"
+"        After the above, output statistics: for each\n"
+"        file, the bytes and lines read and the num-\n"
+"        ber of tokens of each type in lines that were\n"
+"        tokenized; the number of line pairs matched\n"
+"        without being tokenized; the time spent\n"
+"        in total, reading lines, tokenizing, and\n"
+"        comparing numbers; and the peak memory of\n"
+"        the process.  With -json these are in a\n"
+"        stats member instead.  Timing slows scoring\n"
+"        somewhat, and with -threads the times are\n"
+"        summed over all threads.\n"
+"\f\n"
+"    -index\n"
+"        Read the lines and tokens of the test file\n"
+"        from a binary index file, so that only the\n"
+"        output file is scanned.  The index file is\n"
+"        the test file's real path with `.idx' ap-\n"
+"        pended.  If it does not exist or does not\n"
+"        match the test file's size, modification\n"
+"        time, and inode, it is built and, if the\n"
+"        directory is writable, written.  The output\n"
+"        is the same as without -index.  No index is\n"
+"        used for test files that are not regular\n"
+"        files or contain illegal characters, and\n"
+"        -threads does not split files with an\n"
+"        index.\n"
+"\f\n"
+"    -batch manifest\n"
+"        Score many pairs of files with one process.\n"
+"        Each non-blank line of the manifest file\n"
+"        names an output_file, a test_file, and a\n"
+"        score_file, separated by whitespace.  The\n"
+"        output for each pair is written to its\n"
+"        score_file instead of the standard output\n"
+"        (a score_file of `-' means the standard out-\n"
+"        put).  The manifest may be `-' to read it\n"
+"        from the standard input.  At most one out-\n"
+"        put_file or test_file may be `-', and none\n"
+"        if the manifest is `-'.  The exit code is\n"
+"        1 if any manifest line is malformed or any\n"
+"        file cannot be read or written, but all the\n"
+"        other lines are still scored.\n"
+"\n"
+"    -threads N\n"
+"        With -batch, score up to N pairs of files\n"
+"        concurrently.  Score files are still written\n"
+"        in manifest order.  Without -batch, split\n"
+"        large regular files into up to N chunks that\n"
+"        are compared concurrently; the output is the\n"
+"        same as without -threads.  Defaults to 1.\n"
+"\f\n"
 "    If two number tokens have identical character\n"
 "    strings except for differences in letter case,\n"
 "    then the tokens are considered to be equal.\n"
@@ -277,6 +509,19 @@ double number_R = NAN;
     // Do disable A or R, set these to NAN.
 long int limit = LIMIT;
     // Limit on error_type_stack length.
+long int threads = 1;
+    // Number of scoring threads.
+bool early = false;
+    // Stop as soon as the result is determined.
+bool json = false;
+    // Output a JSON record instead of text.
+bool stats = false;
+    // Output statistics.
+bool use_index = false;
+    // Use a token index of the test file.
+long int diff_limit = 0;
+    // Maximum number of line differences found by
+    // -diff; 0 if there is no -diff.
 
 // Error serverities:
 //
@@ -306,16 +551,133 @@ const char * token_type_name[] = {
     "word", "separator", "integer", "float",
     "end-of-line" };
 
+// Test file token index (-index).  The index file
+// consists of an index_header followed by an index_line
+// for each line that get_line returns, and then an
+// index_token for each token that get_token returns,
+// including the EOL token ending each line.
+//
+struct index_header
+{
+    char magic[8];	// INDEX_MAGIC.
+    int record_sizes;	// sizeof ( index_line ) << 16
+    			// + sizeof ( index_token ).
+    int line_count;	// line_number after the last
+    			// line.
+    // The size, modification time, inode, and device
+    // of the indexed file.
+    //
+    long long size;
+    long long mtime_sec, mtime_nsec;
+    long long inode, device;
+    long long lines;	// Number of index_lines.
+    long long tokens;	// Number of index_tokens.
+};
+const char INDEX_MAGIC[8] = "EPMIDX1";
+struct index_line
+{
+    long long offset;	// Offset of line in file.
+    long long next;	// Offset of the next line.
+    long long token;	// Index of first token.
+    int length;		// Length of line without `\n'.
+    int line_number;
+    bool is_blank;
+};
+struct index_token
+{
+    double value;	// number ( f ) if INTEGER or
+    			// FLOAT.
+    int start, end, column, places, significant;
+    unsigned char type;
+    bool has_sign, has_high_zero, negative;
+};
+
+enum compression {
+    NOT_COMPRESSED = 0, GZIP, ZSTD };
+
+unsigned const STREAM_BUFFER_SIZE = 1 << 16;
+    // Initial size of the buffer used to read files
+    // that cannot be memory mapped.  The buffer is
+    // doubled as necessary to hold a long line.
+
 struct file
     // Information about one of the input files (output
     // or test file).
 {
-    ifstream stream;	// Input stream.
+    int fd;		// Input file descriptor.
     const char * id;	// Either "Ouput File" or
     			// "Test File".
 
-    string line;	// Current line if file not
+    // Input buffer.  If the file is a regular file it
+    // is memory mapped read-only, so the buffer is the
+    // entire file and lines are scanned in place.
+    // Otherwise (e.g. pipes) the file is read into a
+    // malloc'ed buffer which is compacted and grown as
+    // needed.  A line containing illegal characters is
+    // copied to scratch before they are replaced, so
+    // the buffer is never modified.
+    //
+    char * buffer;	// Mapped file or read buffer.
+    size_t buffer_size;	// Size of buffer.
+    bool mapped;	// True if buffer is mapped.
+    bool shared;	// True if buffer belongs to
+    			// another job (see open_chunk).
+    bool standard_input;
+    			// True if fd is 0 (file `-').
+    bool eof;		// True if read has returned 0
+    			// (always true if mapped).
+    char * next;	// Start of next line in buffer.
+    char * limit;	// End of data in buffer.
+    char * tail;	// malloc'ed copy of last line
+    			// if file does not end with a
+			// new line and is mapped.
+    char * scratch;	// malloc'ed copy of current
+    size_t scratch_size;
+    			// line if it has illegal
+			// characters.
+
+    // Decompression, for compressed files, which are
+    // never mapped.  Compressed data is read into
+    // zbuffer, and [znext,zlimit) is the part not yet
+    // given to the decoder.
+    //
+    compression compressed;
+    void * decoder;	// z_stream or ZSTD_DCtx.
+    char * zbuffer;
+    char * znext;
+    char * zlimit;
+    bool zeof;		// True if read of compressed
+    			// data has returned 0.
+    bool zend;		// True if decoder is at the end
+    			// of a gzip member or zstd
+			// frame.
+    const char * read_error;
+    			// NULL, or message if reading
+			// failed before the end of the
+			// file, which is then treated
+			// as ending there.
+
+    // Token index, if the lines and tokens of the file
+    // are read from an index instead of being scanned.
+    // The index is mapped if index_mapped, else
+    // malloc'ed.  index is NULL if there is no index.
+    //
+    char * index;
+    size_t index_size;
+    bool index_mapped;
+    const index_line * next_index_line;
+    const index_line * end_index_line;
+    const index_token * next_index_token;
+    const index_token * indexed;
+    			// Current token if indexed,
+			// else NULL.
+
+    char * line;	// Current line if file not
     			// at_end or at beginning.
+    char * line_end;	// End of current line.  Always
+    			// * line_end == '\n', which
+			// acts as a sentinel for token
+			// scanning.
     int line_number;	// After end of file this is
     			// number of lines in file.
 			// 0 if file before first line.
@@ -332,6 +694,15 @@ struct file
     			// Line number of first line
 			// with illegal character (or
 			// 0 if no illegal characters).
+    long long bytes;	// Number of bytes of lines
+    			// read so far.
+
+    // Statistics for -stats.
+    //
+    long long token_count[EOL+1];
+    			// Number of tokens of each
+			// type scanned.
+    double io_time;	// Time spent reading lines.
 
     // Token description.
     //
@@ -340,7 +711,10 @@ struct file
     int column;		// Column within the line of
     			// the last character of the
 			// the current token.  The first
-			// column is 1.
+			// column is 1.  Only set by
+			// get_token if its CHECKS
+			// include CHECK_COLUMN; see
+			// token_column.
     int places;		// Number of decimal places if
     			// type == FLOAT.  0 if type ==
 			// INTEGER.
@@ -349,6 +723,13 @@ struct file
     bool has_high_zero;	// When type == INTEGER, true
     			// iff token has high order
 			// zero.
+    bool negative;	// When type == INTEGER, true
+    			// iff token has - sign.
+    int significant;	// When type == INTEGER, line
+    			// [significant,end-1] are the
+			// digits after any sign and
+			// high order zeros (empty if
+			// the integer is zero).
     char token[81];	// Copy of token for error
     			// messages, computed by the
 			// `token' function.  Middle
@@ -357,25 +738,345 @@ struct file
 
 };
 
-// The two files.
+int const MAX_ERROR_TYPES = 32;
+    // Upper bound on number of error_types.
+
+// A difference found by -diff: output_count output
+// lines beginning at output_line are replaced by
+// test_count test lines beginning at test_line.  A
+// count may be 0, in which case its line is unused.
+//
+struct diff_hunk
+{
+    int output_line, output_count;
+    int test_line, test_count;
+};
+
+struct error_type;
+struct error_record
+    // Per-job information about one error_type.
+{
+    char buffer[4096];
+        // Error output for first error of this kind.
+    long long count;
+        // Number of errors of this kind detected so
+	// far.
+
+    // Description of the first error of this kind
+    // for -json: the message is at buffer + message,
+    // and for each file there is the line number and,
+    // if there is a current token, its end column and
+    // text (else column is 0).
+    //
+    int message;
+    int line_number[2];
+    int column[2];
+    char token[2][81];
+};
+
+struct job
+    // State of scoring one output file against one
+    // test file.  Options and error_type descriptions
+    // are shared read-only by all jobs, so jobs can run
+    // concurrently in separate threads.
+{
+    file files[2];	// The two files.
+    file & output;	// files[0]
+    file & test;	// files[1]
+
+    error_record errors[MAX_ERROR_TYPES];
+        // Indexed by error_type index.
+
+    // Stack of error_types.  An error_type is pushed
+    // into this stack when first encountered, using
+    // error_type_count as the length of the stack.
+    // If stack length becomes above limit, the
+    // program gives up before processing the next
+    // line pair.
+    //
+    error_type * error_type_stack[MAX_ERROR_TYPES];
+    int error_type_count;
+
+    int max_severity;
+
+    bool stopped;
+        // Set by error when -early is given and the
+	// summary score and the error types to be
+	// described can no longer change.
+    bool gave_up;
+        // Set by compare when more than limit error
+	// types have been found.
+    double start_time;
+        // Time scoring started, for -json and -stats.
+
+    // Times for -stats.
+    //
+    double token_time;	// Time spent in get_token.
+    double number_time;	// Time spent comparing numbers.
+    long long matched_lines;
+        // Line pairs matched by lines_match without
+	// being tokenized.
+
+    // Statistics on float comparisons.
+    //
+    long long float_comparisons;
+    double max_A;
+    double max_R;
+
+    // Line diff for -diff.
+    //
+    bool diffed;	// True if the diff was computed.
+    bool diff_exceeded;
+        // True if the lines after the common prefix
+	// differ in more than diff_limit places.
+    long diff_lines[2];
+        // Number of lines compared in each file.
+    long diff_matching;
+        // Number of lines in each file that match.
+    int diff_first[2];
+        // If diff_exceeded, the line numbers of the
+	// first differing lines, or 0 for end of file.
+    vector<diff_hunk> diff_hunks;
+
+    job ( void ) : output ( files[0] ),
+                   test ( files[1] )
+    {
+	for ( int i = 0; i < 2; ++ i )
+	{
+	    files[i].fd = -1;
+	    files[i].tail = files[i].scratch = NULL;
+	    files[i].scratch_size = 0;
+	    files[i].buffer = NULL;
+	    files[i].shared = false;
+	    files[i].standard_input = false;
+	    files[i].index = NULL;
+	    files[i].index_mapped = false;
+	    files[i].decoder = NULL;
+	    files[i].zbuffer = NULL;
+	    files[i].read_error = NULL;
+	}
+    }
+
+    void close_files ( void );
+    bool open_files ( const char * output_file_name,
+                      const char * test_file_name,
+		      ostream & out );
+    char * print_file_lines ( char * p );
+    void error ( error_type & e,
+                 const char * format... );
+    bool integers_are_equal ( void );
+    void compare_numbers ( void );
+    void reset ( void );
+    void open_chunk ( job & whole,
+                      char * const * begin,
+                      char * const * end,
+		      const int * lines );
+    template < unsigned CHECKS >
+    void compare_lines ( void );
+    void compare ( void );
+    void compare_chunks ( int n );
+    void diff ( const char * output_file_name,
+                const char * test_file_name );
+    void report ( ostream & out );
+    void report_diff ( ostream & out );
+    void report_json ( ostream & out );
+    void report_stats ( ostream & out );
+    bool score ( const char * output_file_name,
+                 const char * test_file_name,
+	         ostream & out, int chunks = 1 );
+};
+
+// Write s to out as a JSON string.
+//
+void json_string ( ostream & out, const char * s )
+{
+    out << '"';
+    for ( ; * s; ++ s )
+    {
+        char c = * s;
+	if ( c == '"' || c == '\\' )
+	    out << '\\' << c;
+	else if ( c == '\n' )
+	    out << "\\n";
+	else if ( c == '\t' )
+	    out << "\\t";
+	else if ( ( c & 0200 ) == 0 && c < ' ' )
+	{
+	    char buffer[8];
+	    sprintf ( buffer, "\\u%04x", c );
+	    out << buffer;
+	}
+	else
+	    out << c;
+    }
+    out << '"';
+}
+
+// Write x to out as a JSON number, or null if x is a
+// NaN.  Infinities are written as out of range
+// numbers.
+//
+void json_number ( ostream & out, double x )
+{
+    char buffer[40];
+    if ( isnan ( x ) )
+        strcpy ( buffer, "null" );
+    else if ( isinf ( x ) )
+        strcpy ( buffer, x > 0 ? "1e999" : "-1e999" );
+    else
+        sprintf ( buffer, "%.17g", x );
+    out << buffer;
+}
+
+// Return the current monotonic time in seconds.
+//
+double now ( void )
+{
+    struct timespec t;
+    clock_gettime ( CLOCK_MONOTONIC, & t );
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Return the peak resident memory of the process in
+// kilobytes.
+//
+long peak_memory ( void )
+{
+    struct rusage usage;
+    if ( getrusage ( RUSAGE_SELF, & usage ) < 0 )
+        return 0;
+    return usage.ru_maxrss;
+}
+
+// Timing for -stats.  The time from stats_start to
+// stats_stop is added to total, but only if -stats
+// was given, so the clock is not read otherwise.
+//
+inline double stats_start ( void )
+{
+    return stats ? now() : 0;
+}
+inline void stats_stop ( double start, double & total )
+{
+    if ( stats ) total += now() - start;
+}
+
+// Close the file descriptor of f and free its
+// decoder, leaving its buffer and current line
+// intact.  Does nothing if already done.  The
+// standard input is not closed but replaced by
+// /dev/null, so a pipe writer still gets SIGPIPE
+// but descriptor 0 is never reused by a later open.
+//
+void close_input ( file & f )
+{
+    if ( f.fd < 0 ) return;
+    if ( ! f.standard_input )
+        close ( f.fd );
+    else
+    {
+        int null_fd = open ( "/dev/null", O_RDONLY );
+	if ( null_fd > 0 )
+	{
+	    dup2 ( null_fd, 0 );
+	    close ( null_fd );
+	}
+    }
+    f.fd = -1;
+    if ( f.compressed == GZIP )
+    {
+	inflateEnd ( (z_stream *) f.decoder );
+	delete (z_stream *) f.decoder;
+    }
+#   ifdef EPM_ZSTD
+	if ( f.compressed == ZSTD )
+	    ZSTD_freeDCtx ( (ZSTD_DCtx *) f.decoder );
+#   endif
+    f.decoder = NULL;
+    free ( f.zbuffer );
+    f.zbuffer = NULL;
+}
+
+// Close files opened by open_files or open_chunk.
+//
+void job::close_files ( void )
+{
+    for ( int i = 0; i < 2; ++ i )
+    {
+	file & f = files[i];
+	free ( f.tail );
+	free ( f.scratch );
+	f.tail = f.scratch = NULL;
+	if ( f.index_mapped )
+	    munmap ( f.index, f.index_size );
+	else
+	    free ( f.index );
+	f.index = NULL;
+	if ( f.shared ) continue;
+	close_input ( f );
+	if ( ! f.mapped )
+	    free ( f.buffer );
+	else if ( f.buffer != NULL )
+	    munmap ( f.buffer, f.buffer_size );
+	f.buffer = NULL;
+    }
+}
+
+// Write the error message `ERROR: message file_name'
+// to out, or with -json the JSON record {"error":
+// "message file_name"}.
 //
-file files[2];
-file & output = files[0];
-file & test = files[1];
+void open_error ( ostream & out, const char * message,
+                  const char * file_name )
+{
+    if ( json )
+    {
+	out << "{\"error\":";
+	json_string ( out, ( string ( message )
+	                     + file_name ).c_str() );
+	out << "}" << endl;
+    }
+    else
+	out << "ERROR: " << message << file_name << endl;
+}
 
-// Open files for reading.
+// Open files for reading.  Regular files are memory
+// mapped; if this fails or the file is not regular
+// a read buffer is allocated instead.  If a file is
+// not readable, write an error message to out and
+// return false.
 //
-void open_files ( const char * output_file_name,
-                  const char * test_file_name )
+bool job::open_files
+	( const char * output_file_name,
+	  const char * test_file_name,
+	  ostream & out )
 {
+    for ( int i = 0; i < 2; ++ i )
+    {
+        files[i].fd = -1;
+	files[i].buffer = NULL;
+	files[i].shared = false;
+    }
     for ( int i = 0; i < 2; ++ i )
     {
 	file & f = files[i];
         f.at_end = f.is_blank = false;
+	f.read_error = NULL;
 	f.line_number = 0;
 	f.type = NO_TOKEN;
 	f.illegal_count = 0;
 	f.illegal_line_number = 0;
+	f.bytes = 0;
+	for ( int t = 0; t <= EOL; ++ t )
+	    f.token_count[t] = 0;
+	f.io_time = 0;
+	f.tail = f.scratch = NULL;
+	f.index = NULL;
+	f.indexed = NULL;
+	f.compressed = NOT_COMPRESSED;
+	f.decoder = NULL;
+	f.zbuffer = NULL;
+	f.scratch_size = 0;
 
 	const char * file_name;
 	if ( i == 0 )
@@ -388,13 +1089,279 @@ void open_files ( const char * output_file_name,
 	    f.id = "Test File";
 	    file_name = test_file_name;
 	}
-	f.stream.open ( file_name );
-	if ( ! f.stream ) {
-	    cout << "ERROR: not readable: "
-		 << file_name << endl;
-	    exit ( 1 );
+	f.standard_input =
+	    ( strcmp ( file_name, "-" ) == 0 );
+	if ( f.standard_input )
+	    f.fd = 0;
+	else
+	    f.fd = open ( file_name, O_RDONLY );
+	if ( f.fd < 0 ) {
+	    open_error ( out, "not readable: ",
+	                 file_name );
+	    close_files();
+	    return false;
+	}
+
+	// Check for compressed files by their magic
+	// numbers.  This fails harmlessly if the file
+	// is not seekable.
+	//
+	unsigned char magic[4];
+	if ( pread ( f.fd, magic, 4, 0 ) == 4 )
+	{
+	    if ( magic[0] == 0x1f && magic[1] == 0x8b )
+	        f.compressed = GZIP;
+	    else
+	    if (    magic[0] == 0x28 && magic[1] == 0xb5
+	         && magic[2] == 0x2f && magic[3] == 0xfd )
+	        f.compressed = ZSTD;
+	}
+	if ( f.compressed == GZIP )
+	{
+	    z_stream * z = new z_stream;
+	    memset ( z, 0, sizeof ( * z ) );
+	    if ( inflateInit2 ( z, 16 + MAX_WBITS )
+	         != Z_OK )
+	    {
+	        delete z;
+		f.compressed = NOT_COMPRESSED;
+		open_error ( out, "cannot decompress: ",
+		             file_name );
+		close_files();
+		return false;
+	    }
+	    f.decoder = z;
+	}
+	else if ( f.compressed == ZSTD )
+	{
+#	    ifdef EPM_ZSTD
+		f.decoder = ZSTD_createDCtx();
+		assert ( f.decoder != NULL );
+#	    else
+		f.compressed = NOT_COMPRESSED;
+		open_error ( out, "zstd compressed but"
+		                  " epm_score compiled"
+				  " without -DEPM_ZSTD: ",
+			     file_name );
+		close_files();
+		return false;
+#	    endif
+	}
+	if ( f.compressed != NOT_COMPRESSED )
+	{
+	    f.zbuffer = (char *)
+	        malloc ( STREAM_BUFFER_SIZE );
+	    assert ( f.zbuffer != NULL );
+	    f.znext = f.zlimit = f.zbuffer;
+	    f.zeof = f.zend = false;
+	}
+
+	struct stat st;
+	f.mapped = false;
+	if ( f.compressed == NOT_COMPRESSED
+	     &&
+	     fstat ( f.fd, & st ) == 0
+	     &&
+	     S_ISREG ( st.st_mode ) )
+	{
+	    f.buffer_size = st.st_size;
+	    if ( f.buffer_size == 0 )
+	    {
+	        f.buffer = NULL;
+		f.mapped = true;
+	    }
+	    else
+	    {
+		void * m = mmap ( NULL, f.buffer_size,
+				  PROT_READ, MAP_PRIVATE,
+				  f.fd, 0 );
+		if ( m != MAP_FAILED )
+		{
+		    f.buffer = (char *) m;
+		    f.mapped = true;
+		    madvise ( m, f.buffer_size,
+			      MADV_SEQUENTIAL );
+		}
+	    }
+	}
+	if ( f.mapped )
+	{
+	    f.eof = true;
+	    f.limit = f.buffer + f.buffer_size;
+	}
+	else
+	{
+	    f.eof = false;
+	    f.buffer_size = STREAM_BUFFER_SIZE;
+	    f.buffer = (char *) malloc ( f.buffer_size );
+	    assert ( f.buffer != NULL );
+	    f.limit = f.buffer;
+	}
+	f.next = f.buffer;
+    }
+    return true;
+}
+
+// Read up to n bytes of the contents of f into p,
+// decompressing them if f is compressed.  Returns the
+// number of bytes read, 0 at the end of the file, or
+// -1 with errno set on error, like read.  A corrupt
+// or truncated compressed file is treated as ending
+// at the error, and f.read_error is set.
+//
+ssize_t read_input ( file & f, char * p, size_t n )
+{
+    if ( f.compressed == NOT_COMPRESSED )
+        return read ( f.fd, p, n );
+
+    while ( true )
+    {
+	if ( f.znext == f.zlimit && ! f.zeof )
+	{
+	    ssize_t r = read ( f.fd, f.zbuffer,
+	                       STREAM_BUFFER_SIZE );
+	    if ( r < 0 && errno == EINTR ) continue;
+	    if ( r < 0 ) return -1;
+	    if ( r == 0 ) f.zeof = true;
+	    f.znext = f.zbuffer;
+	    f.zlimit = f.zbuffer + r;
+	}
+
+	size_t produced = 0;
+	bool error = false;
+	if ( f.compressed == GZIP )
+	{
+	    z_stream * z = (z_stream *) f.decoder;
+	    if ( f.zend )
+	    {
+	        // Another gzip member may follow.
+		//
+		if ( f.znext == f.zlimit )
+		{
+		    if ( f.zeof ) return 0;
+		    continue;
+		}
+		inflateReset ( z );
+		f.zend = false;
+	    }
+	    z->next_in = (Bytef *) f.znext;
+	    z->avail_in = f.zlimit - f.znext;
+	    z->next_out = (Bytef *) p;
+	    z->avail_out = n;
+	    int r = inflate ( z, Z_NO_FLUSH );
+	    f.znext = (char *) z->next_in;
+	    produced = n - z->avail_out;
+	    if ( r == Z_STREAM_END ) f.zend = true;
+	    else if ( r != Z_OK && r != Z_BUF_ERROR )
+	        error = true;
+	}
+#	ifdef EPM_ZSTD
+	    else
+	    {
+		ZSTD_inBuffer in =
+		    { f.znext, (size_t)
+		               ( f.zlimit - f.znext ), 0 };
+		ZSTD_outBuffer out = { p, n, 0 };
+		size_t r = ZSTD_decompressStream
+		    ( (ZSTD_DCtx *) f.decoder,
+		      & out, & in );
+		f.znext += in.pos;
+		produced = out.pos;
+		error = ZSTD_isError ( r );
+		f.zend = ( r == 0 );
+	    }
+#	endif
+
+	if ( error )
+	{
+	    f.read_error = "corrupt compressed data: ";
+	    f.znext = f.zlimit;
+	    f.zeof = true;
+	    return produced;
+	}
+	if ( produced > 0 ) return produced;
+	if ( f.zeof && f.znext == f.zlimit )
+	{
+	    if ( ! f.zend )
+		f.read_error =
+		    "truncated compressed data: ";
+	    return 0;
+	}
+    }
+}
+
+// Set f.line and f.line_end to the next line of f and
+// return true, or return false if there is no next
+// line.  The `\n' at the end of the line is left in
+// place as a sentinel; if the file does not end with
+// a `\n', one is supplied.
+//
+bool next_line ( file & f )
+{
+    char * nl = NULL;
+    if ( f.next < f.limit )
+        nl = (char *)
+	    memchr ( f.next, '\n', f.limit - f.next );
+    while ( nl == NULL && ! f.eof )
+    {
+        // Move partial line to start of buffer and
+	// read more, growing buffer if it is full.
+	// The last byte of the buffer is reserved
+	// for a supplied `\n'.
+	//
+	size_t n = f.limit - f.next;
+	memmove ( f.buffer, f.next, n );
+	if ( n + 1 >= f.buffer_size )
+	{
+	    f.buffer_size *= 2;
+	    f.buffer = (char *)
+	        realloc ( f.buffer, f.buffer_size );
+	    assert ( f.buffer != NULL );
+	}
+	f.next = f.buffer;
+	f.limit = f.buffer + n;
+	ssize_t r = read_input ( f, f.limit,
+	                         f.buffer_size - n - 1 );
+	if ( r < 0 && errno == EINTR ) continue;
+	if ( r < 0 && f.read_error == NULL )
+	    f.read_error = "read error: ";
+	if ( r <= 0 )
+	{
+	    f.eof = true;
+	    break;
+	}
+	nl = (char *) memchr ( f.limit, '\n', r );
+	f.limit += r;
+    }
+
+    if ( nl == NULL )
+    {
+        if ( f.next == f.limit ) return false;
+	size_t n = f.limit - f.next;
+	if ( f.mapped )
+	{
+	    // Reading past the mapping is not safe,
+	    // so copy the last line.
+	    //
+	    f.tail = (char *) malloc ( n + 1 );
+	    assert ( f.tail != NULL );
+	    memcpy ( f.tail, f.next, n );
+	    f.line = f.tail;
 	}
+	else
+	    f.line = f.next;
+	f.line_end = f.line + n;
+	* f.line_end = '\n';
+	f.next = f.limit;
+	f.bytes += n;
+	return true;
     }
+
+    f.line = f.next;
+    f.line_end = nl;
+    f.next = nl + 1;
+    f.bytes += f.next - f.line;
+    return true;
 }
 
 // Get next line.  Skip lines beginning with `!!'.  If
@@ -409,13 +1376,53 @@ void open_files ( const char * output_file_name,
 void get_line ( file & f )
 {
     if ( f.at_end ) return;
+    if ( f.index != NULL )
+    {
+	f.type   = NO_TOKEN;
+	f.start  = 0;
+	f.end    = 0;
+	f.column = 0;
+        if ( f.next_index_line == f.end_index_line )
+	{
+	    f.at_end = true;
+	    f.is_blank = false;
+	    f.line_number = ( (index_header *) f.index )
+	                    ->line_count;
+	    f.bytes = f.buffer_size;
+	    return;
+	}
+	const index_line & l = * f.next_index_line ++;
+	f.line = f.buffer + l.offset;
+	if (    (size_t) ( l.offset + l.length )
+	     == f.buffer_size )
+	{
+	    // Last line does not end with `\n'.
+	    //
+	    f.tail = (char *) malloc ( l.length + 1 );
+	    assert ( f.tail != NULL );
+	    memcpy ( f.tail, f.line, l.length );
+	    f.line = f.tail;
+	}
+	f.line_end = f.line + l.length;
+	f.line_number = l.line_number;
+	f.is_blank = l.is_blank;
+	f.bytes = l.next;
+	f.next_index_token =
+	    (const index_token *) f.end_index_line
+	    + l.token;
+	return;
+    }
+
     const char * p;
     while ( true )
     {
 	p = NULL;
-	if ( ! getline ( f.stream, f.line ) ) break;
+	double start = stats_start();
+	bool found = next_line ( f );
+	stats_stop ( start, f.io_time );
+	if ( ! found ) break;
 	++ f.line_number;
-        p = f.line.c_str();
+        p = f.line;
 	if ( p[0] != '!' || p[1] != '!' ) break;
     }
 
@@ -429,47 +1436,40 @@ void get_line ( file & f )
 	//
 	f.is_blank = true;
 	bool has_illegal = false;
-	while ( ! has_illegal && * p )
+	const char * e = f.line_end;
+	while ( ! has_illegal && p < e )
 	{
-	    char c = * p ++;
-	    if ( c & 0200 ) f.is_blank = false;
-	    else switch ( c )
+	    unsigned k = char_class ( * p ++ );
+	    if ( ! ( k & CLASS_BLANK ) )
 	    {
-	        case ' ':
-		case '\t':
-		case '\n':
-		case '\r':
-		    break;
-		default:
-		    f.is_blank = false;
-		    has_illegal =
-		        ( c < ' ' || c > '~' );
+		f.is_blank = false;
+		has_illegal = ( k & CLASS_ILLEGAL );
 	    }
 	}
 
 	if ( has_illegal )
 	{
-	    size_t s = f.line.size();
-	    for ( size_t i = 0; i < s; ++ i )
+	    size_t n = e - f.line;
+	    if ( f.scratch_size < n + 1 )
 	    {
-		char & c = f.line[i];
-		if ( c & 0200 ) continue;
-		switch ( c )
+		f.scratch_size = 2 * n + 1;
+	        free ( f.scratch );
+		f.scratch = (char *)
+		    malloc ( f.scratch_size );
+		assert ( f.scratch != NULL );
+	    }
+	    memcpy ( f.scratch, f.line, n + 1 );
+	    f.line = f.scratch;
+	    f.line_end = f.scratch + n;
+	    e = f.line_end;
+	    for ( char * q = f.line; q < e; ++ q )
+	    {
+		if ( char_class ( * q ) & CLASS_ILLEGAL )
 		{
-		    case ' ':
-		    case '\t':
-		    case '\n':
-		    case '\r':
-			break;
-		    default:
-			if ( c < ' ' || c > '~' )
-			{
-			    c = ILLEGAL;
-			    if (    ++ f.illegal_count
-			         == 1 )
-				f.illegal_line_number
-				    = f.line_number;
-			}
+		    * q = ILLEGAL;
+		    if ( ++ f.illegal_count == 1 )
+			f.illegal_line_number =
+			    f.line_number;
 		}
 	    }
 	}
@@ -484,10 +1484,12 @@ void get_line ( file & f )
 
     cout << f.id
          << " " << f.line_number
-         << ": "
-	 << ( f.at_end ? "<end-of-file>" :
-	                 f.line.c_str() )
-	 << endl;
+         << ": ";
+    if ( f.at_end )
+        cout << "<end-of-file>";
+    else
+        cout.write ( f.line, f.line_end - f.line );
+    cout << endl;
 }
 
 // Return representation of f's token that has at most
@@ -505,7 +1507,7 @@ const char * token ( file & f, int width = 20 )
         return "<end-of-line>";
 
     int w = f.end - f.start;
-    const char * s = f.line.c_str();
+    const char * s = f.line;
     if ( w <= width )
     {
         strncpy ( f.token, s + f.start, w );
@@ -542,23 +1544,44 @@ const char * token ( file & f, int width = 20 )
     return f.token;
 }
 
+// Return the column of the last character of f's
+// token computed from the beginning of its line, as
+// get_token does when its CHECKS include CHECK_COLUMN.
+// Used to describe errors when get_token does not
+// track columns.
+//
+int token_column ( file & f )
+{
+    int column = 0;
+    for ( const char * p = f.line;
+          p < f.line + f.end; ++ p )
+    {
+        if ( * p == ' ' ) ++ column;
+	else if ( * p == '\t' )
+	    column += 8 - ( column % 8 );
+	else if ( is_space ( * p ) ) continue;
+	else if ( ( * p & 0300 ) != 0200 ) ++ column;
+    }
+    return column;
+}
+
 struct error_type * last = NULL;
     // Tail of chain of error_types, in most important
     // last order.
+int error_type_number = 0;
+    // Number of error_types constructed.
 struct error_type
 {
     const char * title;
     int severity;
-    char buffer[4096];
-        // Error output for first error of this kind.
     const char * option_name;
         // Option name to NOT ignore this error.
 	// NULL if no such option.
     bool ignore;
         // Set to ignore this error.
-    long long count;
-        // Number of errors of this kind detected so
-	// far.
+    int index;
+        // Index of this error type's error_record
+	// in job errors.
     error_type * previous;
         // Pointer to previous error_type in chain.
 
@@ -570,8 +1593,8 @@ struct error_type
         this->severity = severity;
         this->option_name = option_name;
 	ignore = ( option_name != NULL );
-	buffer[0] = 0;
-	count = 0;
+	index = error_type_number ++;
+	assert ( index < MAX_ERROR_TYPES );
 	previous = last;
 	last = this;
     }
@@ -635,20 +1658,11 @@ error_type superfluous_lines_at_end_of_output
 error_type output_ends_too_soon
     ( "Output Ends Too Soon", INCOMPLETE_OUTPUT );
 
-// Stack of error_types.  An error_type is pushed into
-// this stack when first encountered, using error_type_
-// count as the length of the stack.  If stack length
-// becomes above limit, the program gives up before
-// processing the next line pair.
-//
-error_type * error_type_stack[100];
-int error_type_count = 0;
-
 // Write error message content describing current lines
 // for both files into buffer denoted by p and return
 // pointer to NUL at end of content.
 //
-char * print_file_lines ( char * p )
+char * job::print_file_lines ( char * p )
 {
     for ( int i = 0; i < 2; ++ i )
     {
@@ -661,10 +1675,10 @@ char * print_file_lines ( char * p )
 	    p += sprintf ( p, "[**BLANK-LINE**]\n" );
 	else
 	{
-	    int w = files[i].line.size();
-	    const char * s = files[i].line.c_str();
+	    int w = files[i].line_end - files[i].line;
+	    const char * s = files[i].line;
 	    if ( w <= 40 )
-	        p += sprintf ( p, "%s\n", s );
+	        p += sprintf ( p, "%.*s\n", w, s );
 	    else
 	    {
 	        // Be careful not to truncate line in
@@ -683,9 +1697,9 @@ char * print_file_lines ( char * p )
     return p;
 }
 
-// Increment e.count, and return if new count is > 1.
+// Increment e's count, and return if new count is > 1.
 // Else put e on error_type_stack and write an error
-// message to be output into e.buffer.
+// message to be output into e's buffer.
 //
 // Message begins with current file lines, indented by
 // 2 spaces.  This is followed by printf of format...
@@ -695,79 +1709,340 @@ char * print_file_lines ( char * p )
 // non-last line must be indicated by '\n    '
 // (including 4 spaces).
 //
-int max_severity = 0;
-void error ( error_type & e, const char * format... )
+void job::error
+	( error_type & e, const char * format... )
 {
-    if ( ++ e.count > 1 ) return;
+    error_record & r = errors[e.index];
+    if ( ++ r.count > 1 ) return;
     if ( max_severity < e.severity )
 	max_severity = e.severity;
 
     error_type_stack[error_type_count++] = & e;
+    if ( early
+         &&
+	 max_severity >= INCORRECT_OUTPUT
+	 &&
+	 error_type_count >= limit )
+        stopped = true;
 
-    char * p = print_file_lines ( e.buffer );
+    char * p = print_file_lines ( r.buffer );
     strcpy ( p, "    " );
     p += 4;
+    r.message = p - r.buffer;
     va_list args;
     va_start ( args, format );
     p += vsprintf ( p, format, args );
     va_end ( args );
     * p ++ = '\n';
     * p = 0;
-}
+
+    for ( int i = 0; i < 2; ++ i )
+    {
+	file & f = files[i];
+        r.line_number[i] = f.line_number;
+	r.column[i] = 0;
+	r.token[i][0] = 0;
+	if ( f.at_end
+	     ||
+	     f.type == NO_TOKEN || f.type == EOL )
+	    continue;
+	r.column[i] = token_column ( f );
+	strcpy ( r.token[i], token ( f ) );
+    }
+}
+
+// Character class scanners used by get_token.  Each
+// scans a run of characters of one class beginning at
+// p and returns a pointer to the first character not
+// in the class.  Scanning never goes beyond e, which
+// points at the `\n' sentinel ending the line (see
+// next_line).  Illegal characters have been replaced
+// by get_line, so the only whitespace characters in
+// a line are space, tab, and carriage return.
+//
+// When compiled for x86 with SSE2 (the default for
+// x86_64) or AVX2 (e.g. g++ -march=native) the scan
+// classifies 16 or 32 characters at a time while at
+// least that many remain before e, and finishes with
+// a scalar loop.  Blocks are combined with the GCC
+// vector | and & operators.
+//
+#if defined ( __AVX2__ )
+
+    int const BLOCK = 32;
+    typedef __m256i block;
+    typedef unsigned block_mask;
+    inline block load ( const char * p )
+    {
+	return _mm256_loadu_si256 ( (const block *) p );
+    }
+    inline block splat ( char c )
+        { return _mm256_set1_epi8 ( c ); }
+    inline block eq ( block x, block y )
+        { return _mm256_cmpeq_epi8 ( x, y ); }
+    inline block gt ( block x, block y )
+        { return _mm256_cmpgt_epi8 ( x, y ); }
+    inline block_mask bits ( block x )
+        { return _mm256_movemask_epi8 ( x ); }
+
+#elif defined ( __SSE2__ )
+
+    int const BLOCK = 16;
+    typedef __m128i block;
+    typedef unsigned block_mask;
+    inline block load ( const char * p )
+    {
+	return _mm_loadu_si128 ( (const block *) p );
+    }
+    inline block splat ( char c )
+        { return _mm_set1_epi8 ( c ); }
+    inline block eq ( block x, block y )
+        { return _mm_cmpeq_epi8 ( x, y ); }
+    inline block gt ( block x, block y )
+        { return _mm_cmpgt_epi8 ( x, y ); }
+    inline block_mask bits ( block x )
+        { return _mm_movemask_epi8 ( x ); }
+
+#endif
+
+#ifdef __SSE2__
+
+    block_mask const ALL = ( BLOCK == 32 ?
+                             ~ 0u : 0xFFFFu );
+
+    // Masks of the characters of a block that are in
+    // a class.  Bytes are compared as signed, so non-
+    // ASCII bytes (the high bit is the sign) are never
+    // letters, digits, or spaces.
+    //
+    inline block_mask space_bits ( block x )
+    {
+        return bits (   eq ( x, splat ( ' ' ) )
+	              | eq ( x, splat ( '\t' ) )
+	              | eq ( x, splat ( '\r' ) ) );
+    }
+    inline block_mask tab_bits ( block x )
+    {
+        return bits ( eq ( x, splat ( '\t' ) ) );
+    }
+    inline block_mask blank_bits ( block x )
+    {
+        return bits ( eq ( x, splat ( ' ' ) ) );
+    }
+    inline block_mask letter_bits ( block x )
+    {
+	x = x | splat ( 'a' - 'A' );
+        return bits (   gt ( x, splat ( 'a' - 1 ) )
+	              & gt ( splat ( 'z' + 1 ), x ) );
+    }
+    inline block_mask digit_bits ( block x )
+    {
+        return bits (   gt ( x, splat ( '0' - 1 ) )
+	              & gt ( splat ( '9' + 1 ), x ) );
+    }
+    inline block_mask continuation_bits ( block x )
+    {
+	// 10xxxxxx is -128 .. -65 as signed.
+	//
+        return bits ( gt ( splat ( -64 ), x ) );
+    }
+
+#endif
+
+// Skip whitespace, updating column if COLUMN is true.
+// Tabs are set every 8 columns.
+//
+template < bool COLUMN >
+inline const char * skip_space
+	( const char * p, const char * e, int & column )
+{
+#   ifdef __SSE2__
+	while ( e - p >= BLOCK )
+	{
+	    block x = load ( p );
+	    block_mask s = space_bits ( x );
+	    block_mask run = ~ s & ALL;
+	    int n = ( run == 0 ? BLOCK
+			       : __builtin_ctz ( run ) );
+	    if ( COLUMN )
+	    {
+		block_mask m =
+		    ( n == 32 ? ~ 0u
+			      : ( 1u << n ) - 1 );
+		if ( ( tab_bits ( x ) & m ) != 0 )
+		    break;
+		column += __builtin_popcount
+			      ( blank_bits ( x ) & m );
+	    }
+	    p += n;
+	    if ( n < BLOCK ) return p;
+	}
+#   endif
+    while ( p < e && is_space ( * p ) )
+    {
+	if ( ! COLUMN ) ;
+        else if ( * p == ' ' ) ++ column;
+	else if ( * p == '\t' )
+	    column += 8 - ( column % 8 );
+	++ p;
+    }
+    return p;
+}
+
+// Scan letters and non-ASCII characters, counting
+// UTF-8 continuation bytes if COLUMN is true.
+//
+template < bool COLUMN >
+inline const char * scan_word
+	( const char * p, const char * e,
+	  unsigned & continuation_characters )
+{
+#   ifdef __SSE2__
+	while ( e - p >= BLOCK )
+	{
+	    block x = load ( p );
+	    block_mask w = letter_bits ( x )
+	                 | bits ( x );
+	    block_mask run = ~ w & ALL;
+	    int n = ( run == 0 ? BLOCK
+			       : __builtin_ctz ( run ) );
+	    if ( COLUMN )
+	    {
+		block_mask m =
+		    ( n == 32 ? ~ 0u
+			      : ( 1u << n ) - 1 );
+		continuation_characters +=
+		    __builtin_popcount
+			( continuation_bits ( x ) & m );
+	    }
+	    p += n;
+	    if ( n < BLOCK ) return p;
+	}
+#   endif
+    while ( true )
+    {
+	unsigned k = char_class ( * p );
+	if ( k == CLASS_LETTER ) ++ p;
+	else if ( k != CLASS_NON_ASCII ) break;
+	else
+	{
+	    if ( COLUMN && ( * p & 0300 ) == 0200 )
+		++ continuation_characters;
+	    ++ p;
+	}
+    }
+    return p;
+}
+
+// Scan ASCII characters that are not letters, digits,
+// or whitespace.
+//
+inline const char * scan_separator
+	( const char * p, const char * e )
+{
+#   ifdef __SSE2__
+	while ( e - p >= BLOCK )
+	{
+	    block x = load ( p );
+	    block_mask run = letter_bits ( x )
+	                   | digit_bits ( x )
+	                   | space_bits ( x )
+			   | bits ( x );
+	    if ( run != 0 )
+	        return p + __builtin_ctz ( run );
+	    p += BLOCK;
+	}
+#   endif
+    while ( char_class ( * p ) == 0 ) ++ p;
+    return p;
+}
+
+// Scan digits.
+//
+inline const char * scan_digits
+	( const char * p, const char * e )
+{
+#   ifdef __SSE2__
+	while ( e - p >= BLOCK )
+	{
+	    block_mask run =
+	        ~ digit_bits ( load ( p ) ) & ALL;
+	    if ( run != 0 )
+	        return p + __builtin_ctz ( run );
+	    p += BLOCK;
+	}
+#   endif
+    while ( is_digit ( * p ) ) ++ p;
+    return p;
+}
+
+// Checks that get_token and job::compare_lines are
+// specialized for, so that a tokenizer and compare
+// loop for the default options do not track columns,
+// letter case, or high order zeros.
+//
+enum {
+    CHECK_COLUMN	= 1 << 0,
+    CHECK_CASE		= 1 << 1,
+    CHECK_HIGH_ZERO	= 1 << 2,
+    ALL_CHECKS		= ( 1 << 3 ) - 1
+};
 
 // Get next token.  If file at_end or file type is
-// EOL do nothing.  Otherwise set f.type, f.column,
-// f.start, f.end, f.column, f.places, f.has_sign,
-// and f.has_high_zero.
+// EOL do nothing.  Otherwise set f.type, f.start,
+// f.end, f.places, f.has_sign, and f.negative, and
+// also f.column if CHECKS includes CHECK_COLUMN and
+// f.has_high_zero if it includes CHECK_HIGH_ZERO.
 //
+template < unsigned CHECKS >
 void get_token ( file & f )
 {
+    const bool COLUMN = ( CHECKS & CHECK_COLUMN );
+
     if ( f.at_end ) return;
     if ( f.type == EOL ) return;
 
-    const char * lp = f.line.c_str();
-    const char * p = lp + f.end;
-    const char * q;
-    while ( * p && isspace ( * p ) )
+    if ( f.index != NULL )
     {
-        if ( * p == ' ' ) ++ f.column;
-	else if ( * p == '\t' )
-	    f.column += 8 - ( f.column % 8 );
-	++ p;
+        const index_token & t = * f.next_index_token ++;
+	f.indexed = & t;
+	f.type = (token_type) t.type;
+	f.start = t.start;
+	f.end = t.end;
+	f.column = t.column;
+	f.places = t.places;
+	f.significant = t.significant;
+	f.has_sign = t.has_sign;
+	f.has_high_zero = t.has_high_zero;
+	f.negative = t.negative;
+	++ f.token_count[f.type];
+	return;
     }
 
+    const char * lp = f.line;
+    const char * e = f.line_end;
+    const char * p = lp + f.end;
+    const char * q;
+    p = skip_space<COLUMN> ( p, e, f.column );
+
     f.start = p - lp;
     unsigned continuation_characters = 0;
 
-    if ( * p == 0 )
+    if ( p == e )
     {
         f.type = EOL;
 	goto TOKEN_DONE;
     }
-    if ( isalpha ( * p ) || ( * p & 0200 ) )
+    if ( char_class ( * p ) & CLASS_WORD )
     {
-	++ p;
-	while ( true )
-	{
-	    if ( isalpha ( * p ) ) ++ p;
-	    else if ( ( * p & 0200 ) == 0 ) break;
-	    else
-	    {
-	        if ( ( * p & 0300 ) == 0200 )
-		    ++ continuation_characters;
-		++ p;
-	    }
-	}
+	p = scan_word<COLUMN>
+	    ( p + 1, e, continuation_characters );
 	f.type = WORD;
 	goto TOKEN_DONE;
     }
     q = p;
-    while ( * p && ! isdigit ( * p )
-		&& ! isalpha ( * p )
-		&& ! isspace ( * p )
-		&& ( * p & 0200 ) == 0 )
-	 ++ p;
-    if ( isdigit ( * p ) )
+    p = scan_separator ( p, e );
+    if ( is_digit ( * p ) )
     {
 	if ( p > q && p[-1] == '.' ) -- p;
 	if ( p > q && (    p[-1] == '+'
@@ -784,9 +2059,9 @@ void get_token ( file & f )
     //
     f.type = INTEGER;
     f.places = 0;
-    f.has_high_zero = false;
     f.has_sign = false;
 
+    f.negative = ( * p == '-' );
     if ( * p == '+' || * p == '-' )
         f.has_sign = true, ++ p;
     if ( * p == '.' )
@@ -794,15 +2069,20 @@ void get_token ( file & f )
 	++ p;
 	f.type = FLOAT;
     }
-    assert ( isdigit ( * p ) );
+    assert ( is_digit ( * p ) );
         // There must be at least one digit as we were
 	// at start of number.
-    if ( * p == '0' && isdigit ( p[1] ) )
-        f.has_high_zero = true;
+    if ( CHECKS & CHECK_HIGH_ZERO )
+	f.has_high_zero =
+	    ( * p == '0' && is_digit ( p[1] ) );
     q = p;
-    ++ p;
-    while ( isdigit ( * p ) ) ++ p;
+    p = scan_digits ( p + 1, e );
     if ( f.type == FLOAT ) f.places = p - q;
+    else
+    {
+        while ( q < p && * q == '0' ) ++ q;
+	f.significant = q - lp;
+    }
     if ( * p == '.' )
     {
         if ( f.type == FLOAT )
@@ -814,7 +2094,7 @@ void get_token ( file & f )
 	f.type = FLOAT;
 	++ p;
 	q = p;
-	while ( isdigit ( * p ) ) ++ p;
+	p = scan_digits ( p, e );
 	f.places = p - q;
     }
     if ( * p == 'e' || * p == 'E' )
@@ -822,10 +2102,9 @@ void get_token ( file & f )
 	q = p;
         ++ p;
 	if ( * p == '+' || * p == '-' ) ++ p;
-	if ( isdigit ( * p ) )
+	if ( is_digit ( * p ) )
 	{
-	    ++ p;
-	    while ( isdigit ( * p ) ) ++ p;
+	    p = scan_digits ( p + 1, e );
 	    f.type = FLOAT;
 	    goto TOKEN_DONE;
 	}
@@ -834,34 +2113,138 @@ void get_token ( file & f )
 
 TOKEN_DONE:
 
+    ++ f.token_count[f.type];
     f.end = p - lp;
-    f.column += f.end - f.start
-              - continuation_characters;
+    if ( COLUMN )
+	f.column += f.end - f.start
+		  - continuation_characters;
 
 
     if ( debug )
 	cout << f.id
 	     << " " << f.line_number
-	     << ":" << f.column
+	     << ":" << ( COLUMN ? f.column
+	                         : token_column ( f ) )
 	     << " " << token_type_name[f.type]
 	     << " " << token ( f, 40 ) << endl;
 }
 
+// Exactly representable powers of 10.
+//
+double const powers_of_10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+int const MAX_EXACT_POWER = 22;
+unsigned long long const MAX_EXACT_MANTISSA = 1ull << 53;
+
 // Computes the floating point value of the current
 // number token.  May be + - INFINITY.
 //
+// The token is parsed in place.  Up to 19 significant
+// digits are accumulated in an integer mantissa M with
+// a decimal exponent E.  If no non-zero digits were
+// dropped, M <= 2^53, and 10^|E| (possibly after
+// moving some of E into M) is exactly representable,
+// then M * 10^E or M / 10^-E is a single correctly
+// rounded IEEE operation on exact operands (Clinger's
+// fast path).  Other tokens, which are rare in
+// practice, are converted by strtod.
+//
 double number ( file & f )
 {
     assert ( f.type == INTEGER
              ||
 	     f.type == FLOAT );
+    if ( f.indexed != NULL )
+        return f.indexed->value;
+    const char * p = f.line + f.start;
+    const char * e = f.line + f.end;
+
+    bool negative = false;
+    if ( * p == '+' ) ++ p;
+    else if ( * p == '-' ) negative = true, ++ p;
+
+    unsigned long long M = 0;
+    int digits = 0;	// Number of digits in M.
+    long E = 0;
+    bool exact = true;	// False if non-zero digits
+    			// have been dropped.
+    bool fraction = false;
+    for ( ; p < e; ++ p )
+    {
+        char c = * p;
+	if ( c == '.' )
+	{
+	    fraction = true;
+	    continue;
+	}
+	if ( ! is_digit ( c ) ) break;
+	int d = c - '0';
+	if ( digits < 19 )
+	{
+	    M = 10 * M + d;
+	    if ( M != 0 ) ++ digits;
+	    if ( fraction ) -- E;
+	}
+	else
+	{
+	    if ( ! fraction ) ++ E;
+	    if ( d != 0 ) exact = false;
+	}
+    }
+    if ( p < e )
+    {
+        // Exponent.  Very large exponents are
+	// clamped; they are left to strtod anyway.
+	//
+        assert ( * p == 'e' || * p == 'E' );
+	++ p;
+	bool negative_exponent = false;
+	if ( * p == '+' ) ++ p;
+	else if ( * p == '-' )
+	    negative_exponent = true, ++ p;
+	long X = 0;
+	for ( ; p < e; ++ p )
+	    if ( X < 1000000 ) X = 10 * X + ( * p - '0' );
+	E += ( negative_exponent ? - X : X );
+    }
+
+    if ( M == 0 )
+        return ( negative ? -0.0 : 0.0 );
+
+#   if FLT_EVAL_METHOD == 0
+	if ( exact && M <= MAX_EXACT_MANTISSA )
+	{
+	    while ( E > MAX_EXACT_POWER
+		    &&
+		    M <= MAX_EXACT_MANTISSA / 10 )
+		M *= 10, -- E;
+	    double r = M;
+	    if ( 0 <= E && E <= MAX_EXACT_POWER )
+		r *= powers_of_10[E];
+	    else if (    - MAX_EXACT_POWER <= E
+	              && E < 0 )
+		r /= powers_of_10[-E];
+	    else
+		goto SLOW;
+	    return ( negative ? - r : r );
+	}
+    SLOW:
+#   endif
+
     int len = f.end - f.start;
-    char buffer[len+1];
-    strncpy ( buffer, f.line.c_str() + f.start, len );
+    char small[128];
+    char * buffer = ( len < (int) sizeof ( small ) ?
+                      small :
+		      (char *) malloc ( len + 1 ) );
+    assert ( buffer != NULL );
+    memcpy ( buffer, f.line + f.start, len );
     buffer[len] = 0;
     char * endp;
     double r = strtod ( buffer, & endp );
     assert ( * endp == 0 );
+    if ( buffer != small ) free ( buffer );
     if ( r == + HUGE_VAL ) r = + INFINITY;
     else
     if ( r == - HUGE_VAL ) r = - INFINITY;
@@ -870,35 +2253,365 @@ double number ( file & f )
 
 // Tests two integer tokens of arbitrary length for
 // equality.  Ignores initial + sign, initial - sign
-// for zeros, and high order zeros.
-//
-bool integers_are_equal ( void )
-{
-    const char * p1 =
-        output.line.c_str() + output.start;
-    const char * e1 =
-        output.line.c_str() + output.end;
-    const char * p2 =
-        test.line.c_str() + test.start;
-    const char * e2 =
-        test.line.c_str() + test.end;
-
-    int s1 = +1, s2 = +1;
-    if ( * p1 == '+' ) ++ p1;
-    else if ( * p1 == '-' ) s1 = -1, ++ p1;
-    if ( * p2 == '+' ) ++ p2;
-    else if ( * p2 == '-' ) s2 = -1, ++ p2;
-    while ( * p1 == '0' && p1 < e1 ) ++ p1;
-    while ( * p2 == '0' && p2 < e2 ) ++ p2;
-    if ( p1 == e1 && p2 == e2 ) return true;
+// for zeros, and high order zeros, using the
+// significant digits found by get_token.
+//
+bool job::integers_are_equal ( void )
+{
+    int n = output.end - output.significant;
+    if ( n != test.end - test.significant )
+        return false;
+    if ( n == 0 ) return true;
         // Both integers zero.
-    if ( p1 == e1 || p2 == e2 ) return false;
-        // One integer zero.
-    if ( s1 != s2 ) return false;
-        // Non-zero integers of different sign.
-    if ( ( e1 - p1 ) != ( e2 - p2 ) ) return false;
-        // Non-zero integers of different length.
-    return strncmp ( p1, p2, p1 - e1 ) == 0;
+    if ( output.negative != test.negative )
+        return false;
+    return memcmp ( output.line + output.significant,
+                    test.line + test.significant, n )
+	   == 0;
+}
+
+// Tests the integer token of i and the float token of
+// x for exact equality without converting them to
+// IEEE floating point.  Returns false if the value of
+// x is not an integer or the values are unequal.
+//
+// The digits of x, less high and low order zeros, are
+// [ip,ie) followed by [fs,fe), and the value of x is
+// these digits times 10 to the power scale.
+//
+bool integer_equals_float ( file & i, file & x )
+{
+    const char * p = x.line + x.start;
+    const char * e = x.line + x.end;
+    bool negative = ( * p == '-' );
+    if ( * p == '+' || * p == '-' ) ++ p;
+
+    const char * ip = p;
+    const char * ie = scan_digits ( p, e );
+    const char * fs = ie;
+    const char * fe = ie;
+    if ( fs < e && * fs == '.' )
+        fe = scan_digits ( ++ fs, e );
+    long scale = - ( fe - fs );
+    if ( fe < e )
+    {
+        // Exponent, clamped as in number.
+	//
+	p = fe + 1;
+	bool negative_exponent = false;
+	if ( * p == '+' ) ++ p;
+	else if ( * p == '-' )
+	    negative_exponent = true, ++ p;
+	long X = 0;
+	for ( ; p < e; ++ p )
+	    if ( X < 1000000 ) X = 10 * X + ( * p - '0' );
+	scale += ( negative_exponent ? - X : X );
+    }
+
+    while ( ip < ie && * ip == '0' ) ++ ip;
+    if ( ip == ie )
+	while ( fs < fe && * fs == '0' ) ++ fs;
+    while ( fs < fe && fe[-1] == '0' ) -- fe, ++ scale;
+    if ( fs == fe )
+	while ( ip < ie && ie[-1] == '0' )
+	    -- ie, ++ scale;
+
+    long n = i.end - i.significant;
+    long n1 = ie - ip;
+    long n2 = fe - fs;
+    if ( n1 + n2 == 0 ) return n == 0;
+        // x is zero.
+    if ( scale < 0 || n == 0 ) return false;
+    if ( negative != i.negative ) return false;
+    if ( n != n1 + n2 + scale ) return false;
+    const char * d = i.line + i.significant;
+    if ( memcmp ( d, ip, n1 ) != 0
+         ||
+	 memcmp ( d + n1, fs, n2 ) != 0 )
+        return false;
+    for ( d += n1 + n2; d < i.line + i.end; ++ d )
+        if ( * d != '0' ) return false;
+    return true;
+}
+
+// Build the token index of f, which must be mapped,
+// by scanning it with a copy of f.  The index_header
+// fields describing the file are copied from key.
+// Returns a malloc'ed index of index_size bytes, or
+// NULL if the file has illegal characters, as the
+// index does not record them.
+//
+char * build_index ( file & f, const index_header & key,
+                     size_t & index_size )
+{
+    file g;
+    memset ( & g, 0, sizeof ( g ) );
+    g.fd = -1;
+    g.id = f.id;
+    g.buffer = f.buffer;
+    g.buffer_size = f.buffer_size;
+    g.mapped = g.eof = true;
+    g.next = f.buffer;
+    g.limit = f.buffer + f.buffer_size;
+    g.type = NO_TOKEN;
+
+    vector<index_line> lines;
+    vector<index_token> tokens;
+    while ( true )
+    {
+        get_line ( g );
+	if ( g.at_end || g.illegal_count > 0 ) break;
+
+	index_line l;
+	memset ( & l, 0, sizeof ( l ) );
+	l.length = g.line_end - g.line;
+	l.offset = ( g.line == g.tail ?
+	             g.buffer_size - l.length :
+		     g.line - g.buffer );
+	l.next = g.next - g.buffer;
+	l.token = tokens.size();
+	l.line_number = g.line_number;
+	l.is_blank = g.is_blank;
+	lines.push_back ( l );
+
+	do
+	{
+	    get_token<ALL_CHECKS> ( g );
+	    index_token t;
+	    memset ( & t, 0, sizeof ( t ) );
+	    t.type = g.type;
+	    t.start = g.start;
+	    t.end = g.end;
+	    t.column = g.column;
+	    if ( g.type == INTEGER || g.type == FLOAT )
+	    {
+		t.value = number ( g );
+		t.places = g.places;
+		t.significant = g.significant;
+		t.has_sign = g.has_sign;
+		t.has_high_zero = g.has_high_zero;
+		t.negative = g.negative;
+	    }
+	    tokens.push_back ( t );
+	} while ( g.type != EOL );
+    }
+    bool ok = ( g.illegal_count == 0 );
+    free ( g.tail );
+    free ( g.scratch );
+    if ( ! ok ) return NULL;
+
+    size_t lines_size =
+        lines.size() * sizeof ( index_line );
+    size_t tokens_size =
+        tokens.size() * sizeof ( index_token );
+    index_size = sizeof ( index_header )
+               + lines_size + tokens_size;
+    char * index = (char *) malloc ( index_size );
+    assert ( index != NULL );
+    index_header * h = (index_header *) index;
+    * h = key;
+    h->line_count = g.line_number;
+    h->lines = lines.size();
+    h->tokens = tokens.size();
+    char * p = index + sizeof ( index_header );
+    if ( lines_size > 0 )
+	memcpy ( p, & lines[0], lines_size );
+    if ( tokens_size > 0 )
+	memcpy ( p + lines_size, & tokens[0],
+	         tokens_size );
+    return index;
+}
+
+// Return true if the index_size bytes of index, whose
+// header has already been checked against the indexed
+// file of file_size bytes, are consistent: the record
+// counts match index_size, the lines lie within the
+// file in increasing order, and each line's tokens lie
+// within the line and end with its EOL token, and
+// the significant digits of each integer lie within
+// the integer.  Otherwise the index is stale or cor-
+// rupt and must not be trusted.
+//
+bool index_is_valid ( const char * index,
+                      size_t index_size,
+		      long long file_size )
+{
+    const index_header * h =
+        (const index_header *) index;
+    size_t room = index_size - sizeof ( index_header );
+    if ( h->lines < 0 || h->tokens < 0
+         ||
+	    (unsigned long long) h->lines
+	 > room / sizeof ( index_line ) )
+        return false;
+    room -= h->lines * sizeof ( index_line );
+    if (    (unsigned long long) h->tokens
+         != room / sizeof ( index_token )
+	 ||
+	 room % sizeof ( index_token ) != 0 )
+        return false;
+
+    const index_line * lines = (const index_line *)
+        ( index + sizeof ( index_header ) );
+    const index_token * tokens =
+        (const index_token *) ( lines + h->lines );
+    long long previous = 0;
+    for ( long long i = 0; i < h->lines; ++ i )
+    {
+        const index_line & l = lines[i];
+	long long last_token =
+	    ( i + 1 < h->lines ? lines[i+1].token
+	                       : h->tokens );
+	if ( l.offset < previous || l.length < 0
+	     ||
+	     l.offset + l.length > file_size
+	     ||
+	     l.next < l.offset + l.length
+	     ||
+	     l.next > file_size
+	     ||
+	     l.line_number > h->line_count
+	     ||
+	     l.token < 0 || last_token <= l.token
+	     ||
+	     last_token > h->tokens )
+	    return false;
+	previous = l.next;
+	for ( long long j = l.token; j < last_token;
+	                             ++ j )
+	{
+	    const index_token & t = tokens[j];
+	    if ( t.type == NO_TOKEN || t.type > EOL
+	         ||
+		    ( t.type == EOL )
+		 != ( j + 1 == last_token )
+		 ||
+		 t.start < 0 || t.end < t.start
+		 ||
+		 t.end > l.length
+		 ||
+		 ( t.type == INTEGER
+		   &&
+		   ( t.significant < t.start
+		     ||
+		     t.significant > t.end ) ) )
+	        return false;
+	}
+    }
+    return true;
+}
+
+// Set up the token index of the test file f for
+// -index.  The index file name is the real path of
+// file_name with `.idx' appended.  If this exists and
+// matches the size, modification time, inode, and
+// device of the file, it is mapped.  Otherwise the
+// index is built and written to a temporary file that
+// is renamed to the index file, if the directory is
+// writable.  An existing index that fails index_is_
+// valid is rebuilt.  No index is used if f is not
+// mapped or has illegal characters.
+//
+void open_index ( file & f, const char * file_name )
+{
+    struct stat st;
+    if ( ! f.mapped || f.buffer_size == 0
+         ||
+	 fstat ( f.fd, & st ) < 0 )
+        return;
+    char * real = realpath ( file_name, NULL );
+    if ( real == NULL ) return;
+    string index_name = string ( real ) + ".idx";
+    free ( real );
+
+    index_header key;
+    memset ( & key, 0, sizeof ( key ) );
+    memcpy ( key.magic, INDEX_MAGIC,
+             sizeof ( key.magic ) );
+    key.record_sizes = ( sizeof ( index_line ) << 16 )
+                     + sizeof ( index_token );
+    key.size = st.st_size;
+    key.mtime_sec = st.st_mtim.tv_sec;
+    key.mtime_nsec = st.st_mtim.tv_nsec;
+    key.inode = st.st_ino;
+    key.device = st.st_dev;
+
+    int fd = open ( index_name.c_str(), O_RDONLY );
+    struct stat ist;
+    if ( fd >= 0
+         &&
+	 fstat ( fd, & ist ) == 0
+	 &&
+	 ist.st_size >= (off_t) sizeof ( index_header ) )
+    {
+	void * m = mmap ( NULL, ist.st_size, PROT_READ,
+	                  MAP_PRIVATE, fd, 0 );
+	if ( m != MAP_FAILED )
+	{
+	    index_header * h = (index_header *) m;
+	    if ( memcmp ( h->magic, key.magic,
+	                  sizeof ( key.magic ) ) == 0
+		 &&
+		 h->record_sizes == key.record_sizes
+		 &&
+		 h->size == key.size
+		 &&
+		 h->mtime_sec == key.mtime_sec
+		 &&
+		 h->mtime_nsec == key.mtime_nsec
+		 &&
+		 h->inode == key.inode
+		 &&
+		 h->device == key.device
+		 &&
+		 index_is_valid ( (const char *) m,
+		                  ist.st_size,
+				  key.size ) )
+	    {
+		f.index = (char *) m;
+		f.index_size = ist.st_size;
+		f.index_mapped = true;
+	    }
+	    else
+		munmap ( m, ist.st_size );
+	}
+    }
+    if ( fd >= 0 ) close ( fd );
+
+    if ( f.index == NULL )
+    {
+	f.index = build_index ( f, key, f.index_size );
+	if ( f.index == NULL ) return;
+	f.index_mapped = false;
+
+	string temp = index_name + ".XXXXXX";
+	fd = mkstemp ( (char *) temp.c_str() );
+	if ( fd >= 0 )
+	{
+	    const char * p = f.index;
+	    size_t n = f.index_size;
+	    while ( n > 0 )
+	    {
+	        ssize_t r = write ( fd, p, n );
+		if ( r < 0 && errno == EINTR ) continue;
+		if ( r <= 0 ) break;
+		p += r;
+		n -= r;
+	    }
+	    if ( close ( fd ) < 0 || n > 0
+	         ||
+		 chmod ( temp.c_str(), 0644 ) < 0
+		 ||
+	         rename ( temp.c_str(),
+		          index_name.c_str() ) < 0 )
+		unlink ( temp.c_str() );
+	}
+    }
+
+    index_header * h = (index_header *) f.index;
+    f.next_index_line = (const index_line *)
+        ( f.index + sizeof ( index_header ) );
+    f.end_index_line = f.next_index_line + h->lines;
 }
 
 // Compare number tokens using IEEE floating point,
@@ -907,14 +2620,22 @@ bool integers_are_equal ( void )
 //
 // Compute statistics on results.
 //
-long long float_comparisons = 0;
-double max_A = -1;
-double max_R = -1;
-//
-void compare_numbers ( void )
+void job::compare_numbers ( void )
 {
-    double n1 = number ( output );
-    double n2 = number ( test );
+    double start = stats_start();
+
+    // An integer and a float with exactly the same
+    // value are equal for any -float A R, so they are
+    // not converted.
+    //
+    bool exact =
+        ( output.type == INTEGER ?
+	  integer_equals_float ( output, test ) :
+	  test.type == INTEGER
+	  &&
+	  integer_equals_float ( test, output ) );
+    double n1 = ( exact ? 0 : number ( output ) );
+    double n2 = ( exact ? 0 : number ( test ) );
 
     ++ float_comparisons;
     bool A_violation = false;
@@ -943,6 +2664,7 @@ void compare_numbers ( void )
 
 	R_violation = ( R > number_R );
     }
+    stats_stop ( start, number_time );
     if ( A_violation && R_violation )
     {
 	error ( unequal_numbers,
@@ -996,189 +2718,103 @@ void compare_numbers ( void )
 	  token ( test ) );
 }
 
-// Main program.
+// Return true if the lines of f and g are equal as
+// character strings, or, if COLUMN is false, equal
+// but for the lengths of non-empty runs of white-
+// space.  Then the lines have the same tokens, so no
+// errors, and they need not be tokenized.  Most lines
+// of large outputs match, so this makes scoring of
+// correct outputs nearly as fast as memcmp.
 //
-int main ( int argc, char ** argv )
+template < bool COLUMN >
+inline bool lines_match ( file & f, file & g )
 {
-    // Process options.
+    const char * p = f.line;
+    const char * pe = f.line_end;
+    const char * q = g.line;
+    const char * qe = g.line_end;
+    if ( pe - p == qe - q
+         &&
+	 memcmp ( p, q, pe - p ) == 0 )
+        return true;
+    if ( COLUMN ) return false;
 
-    while ( argc >= 2 && argv[1][0] == '-' )
+    int column;
+    p = skip_space<false> ( p, pe, column );
+    q = skip_space<false> ( q, qe, column );
+    while ( p < pe && q < qe )
     {
+	while (    p < pe && q < qe && * p == * q
+	        && ! is_space ( * p ) )
+	    ++ p, ++ q;
+	if ( p < pe && ! is_space ( * p ) )
+	    return false;
+	if ( q < qe && ! is_space ( * q ) )
+	    return false;
+	p = skip_space<false> ( p, pe, column );
+	q = skip_space<false> ( q, qe, column );
+    }
+    return p == pe && q == qe;
+}
 
-	const char * name = argv[1] + 1;
+// Ignore flags of error types with options, set from
+// the error_types after options are processed.
+//
+bool ignore_blank;
+bool ignore_case;
+bool ignore_column;
+bool ignore_integer;
+bool ignore_high_zero;
+bool ignore_sign;
 
-        if ( strncmp ( "doc", name, 3 ) == 0 )
+// Clear the errors and statistics of the job.
+//
+void job::reset ( void )
+{
+    for ( int i = 0; i < error_type_number; ++ i )
+    {
+        errors[i].count = 0;
+	errors[i].buffer[0] = 0;
+    }
+    error_type_count = 0;
+    max_severity = COMPLETELY_CORRECT;
+    stopped = gave_up = false;
+    diffed = diff_exceeded = false;
+    diff_hunks.clear();
+    token_time = number_time = 0;
+    matched_lines = 0;
+    float_comparisons = 0;
+    max_A = max_R = -1;
+}
+
+// Compare the rest of the lines of the files,
+// recording errors.  If more than limit error types
+// are found, set gave_up and stop with the current
+// lines being those to be reported.  Only the
+// checks in CHECKS that can be disabled by options
+// are made.
+//
+template < unsigned CHECKS >
+void job::compare_lines ( void )
+{
+    // Loop through lines.
+    //
+    while ( true )
+    {
+        get_line ( output );
+	get_line ( test );
+
+	if ( error_type_count > limit )
 	{
-	    // Any -doc* option prints documentation
-	    // and exits with no error.
-	    //
-	    FILE * out = popen ( "less -F", "w" );
-	    fputs ( documentation, out );
-	    pclose ( out );
-	    exit ( 0 );
+	    gave_up = true;
+	    break;
 	}
-        else if ( strncmp ( "deb", name, 3 ) == 0 )
-	    debug = true;
-	else if ( strcmp ( "limit", name ) == 0 )
-	{
-	    if ( limit != LIMIT )
-	    {
-	        cerr << "too many " << argv[1]
-		     << " options";
-		exit ( 1 );
-	    }
 
-	    ++ argv, -- argc;
-	    if ( argc < 2 ) break;
-	    char * endp;
-	    limit = strtol ( argv[1], & endp, 10 );
-	    if ( * endp || limit < 0 )
-	    {
-		cerr << "Unrecognized L for"
-			" -limit: "
-		     << argv[1] << endl;
-		exit ( 1 );
-	    }
-	}
-        else if ( strcmp ( "float", name ) == 0 )
-	{
-	    if ( float_opt )
-	    {
-	        cerr << "too many " << argv[1]
-		     << " options";
-		exit ( 1 );
-	    }
-	    float_opt = true;
-
-	    ++ argv, -- argc;
-	    if ( argc < 2 ) break;
-	    if ( strcmp ( "-", argv[1] ) == 0 )
-	        number_A = NAN;
-	    else
-	    {
-	        char * endp;
-		number_A = strtod ( argv[1], & endp );
-		if ( * endp )
-		{
-		    cerr << "Unrecognized A for"
-		            " -float: "
-			 << argv[1] << endl;
-		    exit ( 1 );
-		}
-	    }
-
-	    ++ argv, -- argc;
-	    if ( argc < 2 ) break;
-	    if ( strcmp ( "-", argv[1] ) == 0 )
-	        number_R = NAN;
-	    else
-	    {
-	        char * endp;
-		number_R = strtod ( argv[1], & endp );
-		if ( * endp )
-		{
-		    cerr << "Unrecognized R for"
-		            " -float: "
-			 << argv[1] << endl;
-		    exit ( 1 );
-		}
-	    }
-	    if (    isnan ( number_R )
-	         && isnan ( number_A ) )
-	    {
-		cerr << "BOTH A and R cannot be `-'"
-			" for -float" << endl;
-		exit ( 1 );
-	    }
-	}
-	else
-	{
-	    error_type * ep = last;
-	    bool found = false;
-	    while ( ep != NULL )
-	    {
-		error_type & e = * ep;
-		ep = e.previous;
-
-		if ( e.option_name == NULL ) continue;
-	        if (    strcmp ( name, e.option_name )
-		     != 0 )
-		    continue;
-		if ( ! e.ignore )
-		{
-		    cerr << "too many " << argv[1]
-			 << " options";
-		    exit ( 1 );
-		}
-		e.ignore = false;
-		found = true;
-	    }
-	    if ( ! found )
-	    {
-		cerr << "Unrecognized option -"
-		     << name
-		     << endl;
-		exit (1);
-	    }
-	}
-
-        ++ argv, -- argc;
-    }
-
-    if ( argc < 3 )
-    {
-        cerr << "file name(s) missing"
-	     << endl;
-	exit ( 1 );
-    }
-    if ( argc > 3 )
-    {
-        cerr << "too many arguments"
-	     << endl;
-	exit ( 1 );
-    }
-
-    bool ignore_blank =
-        superfluous_blank_line.ignore;
-    bool ignore_case =
-	word_letter_cases_do_not_match.ignore;
-    bool ignore_column =
-	token_end_columns_are_not_equal.ignore;
-    bool ignore_integer =
-	number_is_not_an_integer.ignore;
-    bool ignore_high_zero =
-	integer_has_high_order_zeros.ignore;
-    bool ignore_sign =
-	integer_has_sign.ignore;
-
-    // Open files.
-
-    open_files ( argv[1], argv[2] );
-
-    // Loop through lines.
-    //
-    while ( true )
-    {
-        get_line ( output );
-	get_line ( test );
-
-	if ( error_type_count > limit )
-	{
-	    char buffer[4096];
-	    print_file_lines ( buffer );
-	    cout << error_type_count
-	         << " Types of Errors Detected" << endl
-		 << "Giving Up At:" << endl
-		 << buffer
-		 << "-----" << endl;
-	    break;
-	}
-
-	if ( output.is_blank
-	     &&
-	     test.is_blank  )
-	    continue;
-	if ( output.is_blank )
+	if ( output.is_blank
+	     &&
+	     test.is_blank  )
+	    continue;
+	if ( output.is_blank )
 	{
 	    if ( ! ignore_blank )
 	        error ( superfluous_blank_line,
@@ -1213,12 +2849,23 @@ int main ( int argc, char ** argv )
 	    break;
 	}
 
+	if ( ! debug
+	     &&
+	     lines_match<CHECKS & CHECK_COLUMN>
+	         ( output, test ) )
+	{
+	    ++ matched_lines;
+	    continue;
+	}
+
 	// Loop to check tokens of non-blank lines.
 	// 
 	while ( true )
 	{
-	    get_token ( output );
-	    get_token ( test );
+	    double start = stats_start();
+	    get_token<CHECKS> ( output );
+	    get_token<CHECKS> ( test );
+	    stats_stop ( start, token_time );
 
 	    if ( output.type == EOL
 	         &&
@@ -1246,7 +2893,7 @@ int main ( int argc, char ** argv )
 		break;
 	    }
 
-	    if (    ! ignore_column
+	    if (    ( CHECKS & CHECK_COLUMN )
 	         && output.column != test.column )
 		error ( token_end_columns_are_not_equal,
 		        "output token `%s' and test"
@@ -1259,7 +2906,7 @@ int main ( int argc, char ** argv )
 	    // continue.  Ditto if tokens are equal as
 	    // character strings but for letter case,
 	    // and either test.type != WORD or
-	    // ignore_case is true.  Otherwise compute:
+	    // CHECK_CASE is not in CHECKS.  Otherwise
 	    //
 	    bool equal_but_for_case = false;
 	        // Tokens are equal as character strings
@@ -1272,11 +2919,18 @@ int main ( int argc, char ** argv )
 	         &&
 		 output.type == test.type )
 	    {
-		const char * p1 = output.line.c_str()
+		const char * p1 = output.line
 				+ output.start;
-		const char * p2 = test.line.c_str()
+		const char * p2 = test.line
 				+ test.start;
 
+		// Identical byte strings are the common
+		// case; check for them first so equal
+		// numbers are never converted.
+		//
+		if ( memcmp ( p1, p2, test_len ) == 0 )
+		    continue;
+
 		// We do NOT trust strncasecmp to
 		// handle non-ASCII UTF-8 encodings
 		// (it might try to treat them
@@ -1301,7 +2955,7 @@ int main ( int argc, char ** argv )
 		    continue;
 		else if ( equal_but_for_case
 		          &&
-			  ( ignore_case
+			  ( ! ( CHECKS & CHECK_CASE )
 			    ||
 			    test.type != WORD ) )
 		    continue;
@@ -1331,7 +2985,10 @@ int main ( int argc, char ** argv )
 			    token ( test ) );
 		else
 		{
-		    if ( ! integers_are_equal() )
+		    double start = stats_start();
+		    bool equal = integers_are_equal();
+		    stats_stop ( start, number_time );
+		    if ( ! equal )
 		      error
 		        ( unequal_integers,
 			  "output integer token %s is"
@@ -1339,11 +2996,11 @@ int main ( int argc, char ** argv )
 			  " integer token %s",
 			  token ( output ),
 			  token ( test ) );
-		    if ( output.has_high_zero
-			 &&
-			 ! test.has_high_zero
+		    if ( ( CHECKS & CHECK_HIGH_ZERO )
 		         &&
-			 ! ignore_high_zero )
+			 output.has_high_zero
+			 &&
+			 ! test.has_high_zero )
 		      error
 			( integer_has_high_order_zeros,
 			  "output integer token %s has"
@@ -1408,7 +3065,7 @@ int main ( int argc, char ** argv )
 			token_type_name
 			    [test.type] );
 	    else
-	    if ( ! ignore_case )
+	    if ( CHECKS & CHECK_CASE )
 		error
 		  ( word_letter_cases_do_not_match,
 		    "output token `%s' and test"
@@ -1416,9 +3073,132 @@ int main ( int argc, char ** argv )
 		    " matching letter cases",
 		    token ( output ),
 		    token ( test ) );
+
+	    if ( stopped ) break;
+	}
+	if ( stopped ) break;
+    }
+}
+
+// Compare the rest of the lines of the files by
+// calling the compare_lines specialized for the
+// checks enabled by options.
+//
+void job::compare ( void )
+{
+    unsigned checks = 0;
+    if ( ! ignore_column )
+        checks |= CHECK_COLUMN;
+    if ( ! ignore_case )
+        checks |= CHECK_CASE;
+    if ( ! ignore_high_zero )
+        checks |= CHECK_HIGH_ZERO;
+
+    switch ( checks )
+    {
+    case 0: compare_lines<0>(); break;
+    case 1: compare_lines<1>(); break;
+    case 2: compare_lines<2>(); break;
+    case 3: compare_lines<3>(); break;
+    case 4: compare_lines<4>(); break;
+    case 5: compare_lines<5>(); break;
+    case 6: compare_lines<6>(); break;
+    case 7: compare_lines<7>(); break;
+    }
+}
+
+// Maximum number of differences written by
+// report_diff.
+//
+int const DIFF_REPORT_LIMIT = 20;
+
+// Write lines n through n + count - 1 of f to out.
+//
+void report_lines
+	( ostream & out, const char * f, int n, int count )
+{
+    if ( count == 1 )
+        out << f << " line " << n;
+    else
+        out << f << " lines " << n << "-"
+	    << n + count - 1;
+}
+
+// Write the line diff of -diff to out.
+//
+void job::report_diff ( ostream & out )
+{
+    out << "Line Diff:" << endl;
+    if ( diff_exceeded )
+    {
+        out << "  More Than " << diff_limit
+	    << " Differences After " << diff_matching
+	    << " Matching Lines," << endl
+	    << "  the first at ";
+	for ( int i = 0; i < 2; ++ i )
+	{
+	    const char * f = ( i == 0 ? "output"
+	                              : "test" );
+	    if ( i == 1 ) out << " and ";
+	    if ( diff_first[i] == 0 )
+	        out << "end of " << f << " file";
+	    else
+	        out << f << " line " << diff_first[i];
+	}
+	out << endl << "-----" << endl;
+	return;
+    }
+
+    out << "  " << diff_matching << " of "
+        << diff_lines[0] << " Output Lines Match "
+	<< diff_matching << " of " << diff_lines[1]
+	<< " Test Lines" << endl;
+    for ( size_t i = 0; i < diff_hunks.size(); ++ i )
+    {
+        if ( i == DIFF_REPORT_LIMIT )
+	{
+	    out << "  and " << diff_hunks.size() - i
+	        << " more differences" << endl;
+	    break;
+	}
+	diff_hunk & h = diff_hunks[i];
+	out << "  ";
+	if ( h.test_count == 0 )
+	{
+	    out << "extra ";
+	    report_lines ( out, "output",
+	                   h.output_line,
+			   h.output_count );
 	}
+	else if ( h.output_count == 0 )
+	{
+	    out << "missing ";
+	    report_lines ( out, "test",
+	                   h.test_line,
+			   h.test_count );
+	}
+	else
+	{
+	    report_lines ( out, "output",
+	                   h.output_line,
+			   h.output_count );
+	    out << " differ"
+	        << ( h.output_count == 1 ? "s" : "" )
+		<< " from ";
+	    report_lines ( out, "test",
+	                   h.test_line,
+			   h.test_count );
+	}
+	out << endl;
     }
+    out << "-----" << endl;
+}
 
+// Write the summary score and error descriptions to
+// out.
+//
+void job::report ( ostream & out )
+{
     if ( max_severity < FORMAT_ERROR
          &&
 	 ( output.illegal_count > 0
@@ -1431,68 +3211,1286 @@ int main ( int argc, char ** argv )
 	 output.line_number == 0 )
         max_severity = NO_OUTPUT;
 
-    cout << severities[max_severity] << endl;
+    if ( json )
+    {
+        report_json ( out );
+	return;
+    }
+
+    if ( gave_up )
+    {
+	char buffer[4096];
+	print_file_lines ( buffer );
+	out << error_type_count
+	    << " Types of Errors Detected" << endl
+	    << "Giving Up At:" << endl
+	    << buffer
+	    << "-----" << endl;
+    }
+
+    out << severities[max_severity] << endl;
     if ( max_severity == COMPLETELY_CORRECT )
-        exit ( 0 );
+        return;
 
     // There are errors, output them.
 
-    cout << "-----" << endl;
+    out << "-----" << endl;
+
+    if ( stopped )
+    {
+	char buffer[4096];
+	print_file_lines ( buffer );
+        out << "Scoring Stopped Early At:" << endl
+	    << buffer
+	    << "-----" << endl;
+    }
 
     for ( int i = 0; i < 2; ++ i )
     {
 	if ( files[i].illegal_count > 0 )
-	    cout << "The " << files[i].id
-	         << " Contains "
-		 << output.illegal_count
-		 << " Illegal Character(s),"
-		 << endl
-		 << "  the first of which is on line "
-		 << files[i].illegal_line_number
-		 << endl
-		 << "-----" << endl;
-    }
-    if ( unequal_numbers.count > 0 )
-    {
-        cout << "There Were " << float_comparisons
-	     << " Float Number Comparisons:"
-	     << endl;
+	    out << "The " << files[i].id
+		<< " Contains "
+		<< files[i].illegal_count
+		<< " Illegal Character(s),"
+		<< endl
+		<< "  the first of which is on line "
+		<< files[i].illegal_line_number
+		<< endl
+		<< "-----" << endl;
+    }
+    if ( errors[unequal_numbers.index].count > 0 )
+    {
+        out << "There Were " << float_comparisons
+	    << " Float Number Comparisons:"
+	    << endl;
 	if ( ! isnan ( number_A ) )
 	{
-	    cout << "  Maximum A = " << max_A
-	         << " > " << number_A;
+	    out << "  Maximum A = " << max_A
+		<< " > " << number_A;
 	    if ( ! isnan ( number_R ) )
-	        cout << " when R violated";
-	    cout << endl;
+	        out << " when R violated";
+	    out << endl;
 	}
 	if ( ! isnan ( number_R ) )
 	{
-	    cout << "  Maximum R = " << max_R
-	         << " > " << number_R;
+	    out << "  Maximum R = " << max_R
+		<< " > " << number_R;
 	    if ( ! isnan ( number_A ) )
-	        cout << " when A violated";
-	    cout << endl;
+	        out << " when A violated";
+	    out << endl;
 	}
-	cout << "-----" << endl;
+	out << "-----" << endl;
     }
 
     for ( int i = 0; i < error_type_count; ++ i )
     {
         error_type & e = * error_type_stack[i];
-	if ( e.count == 1 )
-	    cout << "The One and Only `" << e.title
-	         << "' Error:" << endl;
+	error_record & r = errors[e.index];
+	if ( r.count == 1 )
+	    out << "The One and Only `" << e.title
+		<< "' Error:" << endl;
 	else
-	    cout << "First of " << e.count
-	         << " `" << e.title
-	         << "' Errors:" << endl;
-	cout << e.buffer
-	     << "-----" << endl;
+	    out << "First of " << r.count
+		<< " `" << e.title
+		<< "' Errors:" << endl;
+	out << r.buffer
+	    << "-----" << endl;
+    }
+    if ( diffed )
+        report_diff ( out );
+    out << "End of Error Descriptions" << endl;
+}
+
+// Write the results to out as a one line JSON record
+// for -json.  max_severity has been finalized by
+// report.
+//
+void job::report_json ( ostream & out )
+{
+    out << "{\"score\":";
+    json_string ( out, severities[max_severity] );
+    out << ",\"gave_up\":"
+        << ( gave_up ? "true" : "false" )
+        << ",\"stopped\":"
+        << ( stopped ? "true" : "false" );
+    if ( gave_up || stopped )
+        out << ",\"stopped_at\":{\"output_line\":"
+	    << output.line_number
+	    << ",\"test_line\":"
+	    << test.line_number << "}";
+
+    out << ",\"errors\":[";
+    for ( int i = 0; i < error_type_count; ++ i )
+    {
+        error_type & e = * error_type_stack[i];
+	error_record & r = errors[e.index];
+	if ( i > 0 ) out << ",";
+	out << "{\"type\":";
+	json_string ( out, e.title );
+	out << ",\"severity\":";
+	json_string ( out, severities[e.severity] );
+	out << ",\"count\":" << r.count
+	    << ",\"first\":{";
+	for ( int j = 0; j < 2; ++ j )
+	{
+	    out << ( j == 0 ? "\"output\":" :
+	                      ",\"test\":" )
+	        << "{\"line\":" << r.line_number[j];
+	    if ( r.column[j] > 0 )
+	    {
+		out << ",\"column\":" << r.column[j]
+		    << ",\"token\":";
+		json_string ( out, r.token[j] );
+	    }
+	    out << "}";
+	}
+	out << ",\"message\":";
+	json_string ( out, r.buffer + r.message );
+	out << "}}";
+    }
+    out << "]";
+
+    out << ",\"float_comparisons\":"
+        << float_comparisons
+        << ",\"max_A\":";
+    json_number ( out, max_A < 0 ? NAN : max_A );
+    out << ",\"max_R\":";
+    json_number ( out, max_R < 0 ? NAN : max_R );
+
+    out << ",\"illegal\":{";
+    for ( int i = 0; i < 2; ++ i )
+	out << ( i == 0 ? "\"output\":" :
+	                  ",\"test\":" )
+	    << "{\"count\":" << files[i].illegal_count
+	    << ",\"first_line\":"
+	    << files[i].illegal_line_number << "}";
+    out << "}";
+
+    if ( diffed )
+    {
+	out << ",\"diff\":{\"output_lines\":"
+	    << diff_lines[0]
+	    << ",\"test_lines\":" << diff_lines[1]
+	    << ",\"matching\":" << diff_matching
+	    << ",\"exceeded\":"
+	    << ( diff_exceeded ? "true" : "false" );
+	if ( diff_exceeded )
+	    out << ",\"first\":{\"output_line\":"
+	        << diff_first[0]
+		<< ",\"test_line\":" << diff_first[1]
+		<< "}";
+	out << ",\"differences\":[";
+	for ( size_t i = 0; i < diff_hunks.size(); ++ i )
+	{
+	    diff_hunk & h = diff_hunks[i];
+	    out << ( i == 0 ? "" : "," )
+	        << "{\"output_line\":" << h.output_line
+		<< ",\"output_count\":" << h.output_count
+		<< ",\"test_line\":" << h.test_line
+		<< ",\"test_count\":" << h.test_count
+		<< "}";
+	}
+	out << "]}";
+    }
+
+    out << ",\"elapsed\":";
+    json_number ( out, now() - start_time );
+    out << ",\"bytes\":"
+        << output.bytes + test.bytes;
+
+    if ( stats )
+    {
+	out << ",\"stats\":{";
+	for ( int i = 0; i < 2; ++ i )
+	{
+	    file & f = files[i];
+	    out << ( i == 0 ? "\"output\":" :
+			      ",\"test\":" )
+		<< "{\"bytes\":" << f.bytes
+		<< ",\"lines\":" << f.line_number
+		<< ",\"tokens\":{";
+	    for ( int t = WORD; t <= EOL; ++ t )
+		out << ( t == WORD ? "" : "," )
+		    << "\"" << token_type_name[t]
+		    << "\":" << f.token_count[t];
+	    out << "},\"io_time\":";
+	    json_number ( out, f.io_time );
+	    out << "}";
+	}
+	out << ",\"matched_lines\":" << matched_lines
+	    << ",\"token_time\":";
+	json_number ( out, token_time );
+	out << ",\"number_time\":";
+	json_number ( out, number_time );
+	out << ",\"peak_memory\":" << peak_memory()
+	    << "}";
+    }
+    out << "}" << endl;
+}
+
+// Write the -stats statistics to out.
+//
+void job::report_stats ( ostream & out )
+{
+    char buffer[200];
+    out << "Statistics:" << endl;
+    for ( int i = 0; i < 2; ++ i )
+    {
+        file & f = files[i];
+	out << "  " << f.id << ": " << f.bytes
+	    << " Bytes, " << f.line_number
+	    << " Lines, Tokens:" << endl
+	    << "   ";
+	for ( int t = WORD; t <= EOL; ++ t )
+	    out << ( t == WORD ? " " : ", " )
+	        << f.token_count[t] << " "
+		<< token_type_name[t];
+	out << endl;
+    }
+    sprintf ( buffer,
+              "  Time: %.6f s Total,"
+	      " %.6f s Reading Lines,\n"
+	      "    %.6f s Tokenizing,"
+	      " %.6f s Comparing Numbers\n",
+	      now() - start_time,
+	      output.io_time + test.io_time,
+	      token_time, number_time );
+    out << "  " << matched_lines
+        << " Line Pairs Matched Without Tokenizing"
+	<< endl
+        << buffer
+        << "  Peak Memory: " << peak_memory()
+	<< " KB" << endl;
+}
+
+// Chunked comparison of one large pair of files.
+//
+// Output line i that is neither blank nor a `!!'
+// comment is always compared with test line i of the
+// same kind, and blank lines only matter between
+// such lines.  So if both files are split just after
+// their k'th such lines, the two chunks can be
+// compared separately and their errors merged in
+// file order, giving the same results as comparing
+// the whole files, provided the error type limit is
+// not reached.  If it would be, the chunk where that
+// happens and everything after it are compared again
+// sequentially, so `Giving Up At:' and `Scoring
+// Stopped Early At:' are reported exactly as before.
+//
+size_t const MIN_CHUNK_SIZE = 1 << 20;
+    // Files are not split into chunks smaller than
+    // this, as the threads would cost more than they
+    // save.
+
+struct line_count
+    // Counts of the lines of part of a file.
+{
+    const char * begin;	// Part is [begin,end).
+    const char * end;
+    int lines;		// Number of lines.
+    int nonblank;	// Number of lines that are
+    			// neither blank nor comments.
+};
+
+// Scan the lines in [p,e) counting them in lines and
+// counting lines that are neither blank nor `!!'
+// comments in nonblank, stopping after the line that
+// makes nonblank == stop.  Returns a pointer to the
+// beginning of the next line, or e.
+//
+const char * count_lines
+	( const char * p, const char * e,
+	  int & lines, int & nonblank, int stop )
+{
+    while ( p < e && nonblank != stop )
+    {
+        const char * nl = (const char *)
+	    memchr ( p, '\n', e - p );
+	if ( nl == NULL ) nl = e;
+	++ lines;
+	if ( nl - p < 2 || p[0] != '!' || p[1] != '!' )
+	{
+	    for ( const char * q = p; q < nl; ++ q )
+	    {
+	        if (    * q != ' ' && * q != '\t'
+		     && * q != '\r' )
+		{
+		    ++ nonblank;
+		    break;
+		}
+	    }
+	}
+	p = ( nl == e ? e : nl + 1 );
+    }
+    return p;
+}
+
+// Return the beginning of the line following the
+// k'th line of parts that is neither blank nor a
+// comment, setting lines to the number of lines
+// before the returned position.
+//
+const char * locate_line
+	( const vector<line_count> & parts, int k,
+	  int & lines )
+{
+    int nonblank = 0;
+    lines = 0;
+    size_t i = 0;
+    while ( nonblank + parts[i].nonblank < k )
+    {
+        nonblank += parts[i].nonblank;
+	lines += parts[i].lines;
+	++ i;
     }
-    cout << "End of Error Descriptions" << endl;
+    return count_lines ( parts[i].begin, parts[i].end,
+                         lines, nonblank, k );
+}
 
+// Set up this job to compare the lines of the files
+// of whole that are in [begin[i],end[i]), where
+// lines[i] lines of file i precede begin[i].
+//
+void job::open_chunk
+	( job & whole, char * const * begin,
+	  char * const * end, const int * lines )
+{
+    for ( int i = 0; i < 2; ++ i )
+    {
+	file & f = files[i];
+	file & w = whole.files[i];
+	f.fd = -1;
+	f.id = w.id;
+	f.shared = true;
+	f.standard_input = false;
+	f.read_error = NULL;
+	f.buffer = w.buffer;
+	f.buffer_size = w.buffer_size;
+	f.mapped = f.eof = true;
+	f.next = begin[i];
+	f.limit = end[i];
+        f.at_end = f.is_blank = false;
+	f.line_number = lines[i];
+	f.type = NO_TOKEN;
+	f.illegal_count = 0;
+	f.illegal_line_number = 0;
+	f.bytes = 0;
+	for ( int t = 0; t <= EOL; ++ t )
+	    f.token_count[t] = 0;
+	f.io_time = 0;
+    }
+}
 
-    // Return from main function without error.
+// Compare the files by splitting them into up to n
+// chunks compared concurrently, as described above.
+// Falls back to compare if the files are not both
+// mapped or are too small to be worth splitting.
+//
+void job::compare_chunks ( int n )
+{
+    size_t size = std::min ( output.buffer_size,
+                             test.buffer_size );
+    if ( (size_t) n > size / MIN_CHUNK_SIZE )
+        n = size / MIN_CHUNK_SIZE;
+    if ( debug || n < 2
+         ||
+	 ! output.mapped || ! test.mapped
+	 ||
+	 test.index != NULL )
+    {
+        compare();
+	return;
+    }
+
+    // Split each file into n parts at line boundaries
+    // and count the lines of the parts concurrently.
+    //
+    vector<line_count> parts[2];
+    for ( int i = 0; i < 2; ++ i )
+    {
+	file & f = files[i];
+	parts[i].resize ( n );
+	for ( int p = 0; p < n; ++ p )
+	{
+	    const char * b = f.buffer;
+	    if ( p > 0 )
+	    {
+	        b = (const char *) memchr
+		    ( f.buffer + p * f.buffer_size / n,
+		      '\n', f.limit - f.buffer
+		            - p * f.buffer_size / n );
+		b = ( b == NULL ? f.limit : b + 1 );
+		if ( b < parts[i][p-1].begin )
+		    b = parts[i][p-1].begin;
+		parts[i][p-1].end = b;
+	    }
+	    parts[i][p].begin = b;
+	    parts[i][p].end = f.limit;
+	}
+    }
+    vector<std::thread> workers;
+    for ( int p = 0; p < n; ++ p )
+        workers.push_back ( std::thread ( [&parts,p]
+	{
+	    for ( int i = 0; i < 2; ++ i )
+	    {
+		line_count & c = parts[i][p];
+		c.lines = c.nonblank = 0;
+		count_lines ( c.begin, c.end, c.lines,
+			      c.nonblank, -1 );
+	    }
+	} ) );
+    for ( auto & w : workers ) w.join();
+    workers.clear();
+
+    int K[2] = { 0, 0 };
+    for ( int i = 0; i < 2; ++ i )
+    for ( int p = 0; p < n; ++ p )
+        K[i] += parts[i][p].nonblank;
+    int k = std::min ( K[0], K[1] );
+    if ( k < n )
+    {
+        compare();
+	return;
+    }
+
+    // Chunk c consists of the lines after the
+    // c*k/n'th non-blank line of each file, up to and
+    // including the (c+1)*k/n'th, except that the
+    // last chunk runs to the ends of the files.
+    //
+    vector<char *> begin[2];
+    vector<int> lines[2];
+    for ( int i = 0; i < 2; ++ i )
+    {
+        begin[i].resize ( n + 1 );
+        lines[i].resize ( n + 1 );
+	begin[i][0] = files[i].buffer;
+	begin[i][n] = files[i].limit;
+	lines[i][0] = lines[i][n] = 0;
+    }
+    for ( int c = 1; c < n; ++ c )
+        workers.push_back ( std::thread
+	    ( [&parts,&begin,&lines,c,k,n]
+	{
+	    for ( int i = 0; i < 2; ++ i )
+		begin[i][c] = (char *) locate_line
+		    ( parts[i],
+		      (long long) c * k / n,
+		      lines[i][c] );
+	} ) );
+    for ( auto & w : workers ) w.join();
+    workers.clear();
+
+    vector<job *> chunks ( n );
+    for ( int c = 0; c < n; ++ c )
+        workers.push_back ( std::thread
+	    ( [this,&chunks,&begin,&lines,c]
+	{
+	    job * j = chunks[c] = new job;
+	    char * b[2] = { begin[0][c], begin[1][c] };
+	    char * e[2] = { begin[0][c+1],
+	                    begin[1][c+1] };
+	    int l[2] = { lines[0][c], lines[1][c] };
+	    j->reset();
+	    j->open_chunk ( * this, b, e, l );
+	    j->compare();
+	} ) );
+    for ( auto & w : workers ) w.join();
+
+    // Merge the chunks in order.  Stop before merging
+    // a chunk that would make the error type limit
+    // matter.
+    //
+    int c;
+    for ( c = 0; c < n; ++ c )
+    {
+        job & j = * chunks[c];
+	int new_types = 0;
+	int severity = max_severity;
+	for ( int t = 0; t < j.error_type_count; ++ t )
+	{
+	    error_type & e = * j.error_type_stack[t];
+	    if ( errors[e.index].count > 0 ) continue;
+	    ++ new_types;
+	    if ( severity < e.severity )
+	        severity = e.severity;
+	}
+	if ( j.stopped || j.gave_up
+	     ||
+	     error_type_count + new_types > limit
+	     ||
+	     ( early && new_types > 0
+	       &&
+	       severity >= INCORRECT_OUTPUT
+	       &&
+	       error_type_count + new_types >= limit ) )
+	    break;
+
+	for ( int t = 0; t < j.error_type_count; ++ t )
+	{
+	    error_type & e = * j.error_type_stack[t];
+	    error_record & r = errors[e.index];
+	    long long count = r.count;
+	    if ( count == 0 )
+	    {
+		error_type_stack[error_type_count++]
+		    = & e;
+		r = j.errors[e.index];
+	    }
+	    r.count = count + j.errors[e.index].count;
+	}
+	max_severity = severity;
+	float_comparisons += j.float_comparisons;
+	max_A = std::max ( max_A, j.max_A );
+	max_R = std::max ( max_R, j.max_R );
+	for ( int i = 0; i < 2; ++ i )
+	{
+	    file & f = files[i];
+	    file & g = j.files[i];
+	    if ( f.illegal_line_number == 0 )
+		f.illegal_line_number =
+		    g.illegal_line_number;
+	    f.illegal_count += g.illegal_count;
+	    f.bytes += g.bytes;
+	    for ( int t = 0; t <= EOL; ++ t )
+		f.token_count[t] += g.token_count[t];
+	    f.io_time += g.io_time;
+	}
+	token_time += j.token_time;
+	number_time += j.number_time;
+	matched_lines += j.matched_lines;
+    }
+
+    if ( c < n )
+    {
+        // Compare from the beginning of chunk c to
+	// the ends of the files.
+	//
+	for ( int i = 0; i < 2; ++ i )
+	{
+	    files[i].next = begin[i][c];
+	    files[i].line_number = lines[i][c];
+	}
+	compare();
+    }
+    else for ( int i = 0; i < 2; ++ i )
+    {
+	files[i].line_number =
+	    chunks[n-1]->files[i].line_number;
+	files[i].at_end =
+	    chunks[n-1]->files[i].at_end;
+    }
+
+    for ( c = 0; c < n; ++ c )
+    {
+        chunks[c]->close_files();
+	delete chunks[c];
+    }
+}
+
+// Maximum number of lines after the common prefix of
+// the files that -diff stores, and the maximum D of
+// -diff D.  These bound the memory used to about
+// 8 * MAX_DIFF_LINES + 4 * MAX_DIFF_LIMIT**2 bytes.
+//
+int const MAX_DIFF_LINES = 1 << 22;
+int const MAX_DIFF_LIMIT = 2000;
+
+// Read the next line of f compared by -diff and set
+// hash to the hash of its tokens.  Lines with equal
+// hashes are taken to match: their tokens are equal
+// as character strings, except for letter case in
+// non-words, or in words when case is ignored.  Blank
+// lines are skipped when they are ignored.  Return
+// false if there is no next line.
+//
+bool diff_line ( file & f, unsigned long long & hash )
+{
+    do get_line ( f );
+    while ( ! f.at_end && f.is_blank && ignore_blank );
+    if ( f.at_end ) return false;
+
+    unsigned long long h = 14695981039346656037ull;
+    while ( true )
+    {
+        get_token<0> ( f );
+	if ( f.type == EOL ) break;
+	bool fold = ( f.type != WORD || ignore_case );
+	const char * p = f.line + f.start;
+	const char * e = f.line + f.end;
+	for ( ; p < e; ++ p )
+	{
+	    unsigned char c = * p;
+	    if ( fold && 'A' <= c && c <= 'Z' )
+	        c += 'a' - 'A';
+	    h = ( h ^ c ) * 1099511628211ull;
+	}
+	h = ( h ^ 0x100 ) * 1099511628211ull;
+    }
+    hash = h;
+    return true;
+}
+
+// An edit of a[0..n-1] into b[0..m-1] made after x
+// elements of a and y elements of b: if insert, b[y]
+// is inserted, else a[x] is deleted.
+//
+struct diff_edit
+{
+    int x, y;
+    bool insert;
+};
+
+// Find a shortest edit script turning a[0..n-1] into
+// b[0..m-1] by the greedy algorithm of Myers, `An
+// O(ND) Difference Algorithm and Its Variations'.
+// Return false if it has more than max_d edits, else
+// set edits to the edits in order.  Time is
+// O((n+m)max_d) and space is O(max_d**2).
+//
+bool myers_diff ( const unsigned long long * a, int n,
+                  const unsigned long long * b, int m,
+		  int max_d, vector<diff_edit> & edits )
+{
+    // v[d][k+d] is the furthest x on diagonal k = x - y
+    // reached with d edits.
+    //
+    vector< vector<int> > v;
+    int d_found = -1;
+    for ( int d = 0; d <= max_d && d_found < 0; ++ d )
+    {
+	v.push_back ( vector<int> ( 2 * d + 1 ) );
+	vector<int> & vd = v[d];
+	for ( int k = - d; k <= d; k += 2 )
+	{
+	    int x;
+	    if ( d == 0 )
+	        x = 0;
+	    else if (    k == - d
+	              || (    k != d
+		           &&   v[d-1][k-1+d-1]
+			      < v[d-1][k+1+d-1] ) )
+	        x = v[d-1][k+1+d-1];
+	    else
+	        x = v[d-1][k-1+d-1] + 1;
+	    int y = x - k;
+	    while ( x < n && y < m && a[x] == b[y] )
+	        ++ x, ++ y;
+	    vd[k+d] = x;
+	    if ( x >= n && y >= m )
+	    {
+		d_found = d;
+		break;
+	    }
+	}
+    }
+    if ( d_found < 0 ) return false;
+
+    // Backtrack from (n,m) to (0,0).
+    //
+    edits.clear();
+    int x = n, y = m;
+    for ( int d = d_found; d > 0; -- d )
+    {
+        int k = x - y;
+	vector<int> & vp = v[d-1];
+	int pk;
+	if (    k == - d
+	     || (    k != d
+	          && vp[k-1+d-1] < vp[k+1+d-1] ) )
+	    pk = k + 1;
+	else
+	    pk = k - 1;
+	diff_edit e;
+	e.x = vp[pk+d-1];
+	e.y = e.x - pk;
+	e.insert = ( pk == k + 1 );
+	edits.push_back ( e );
+	x = e.x, y = e.y;
+    }
+    reverse ( edits.begin(), edits.end() );
+    return true;
+}
+
+// Compute the line diff of the files for -diff by
+// reading them again, and set diffed and the other
+// diff members.  Does nothing if the files cannot be
+// opened again.
+//
+void job::diff ( const char * output_file_name,
+                 const char * test_file_name )
+{
+    job * d = new job;
+    ostringstream discard;
+    if ( ! d->open_files ( output_file_name,
+                           test_file_name, discard ) )
+    {
+        delete d;
+	return;
+    }
+
+    // Skip the common prefix of lines, then store the
+    // hashes and line numbers of the rest of the lines
+    // of each file, up to MAX_DIFF_LINES.
+    //
+    vector<unsigned long long> hashes[2];
+    vector<int> lines[2];
+    unsigned long long hash[2];
+    bool more[2];
+    long prefix = 0;
+    while ( true )
+    {
+	for ( int i = 0; i < 2; ++ i )
+	    more[i] = diff_line ( d->files[i], hash[i] );
+	if ( ! more[0] || ! more[1] ) break;
+	if ( hash[0] != hash[1] ) break;
+	++ prefix;
+    }
+    diff_exceeded = false;
+    for ( int i = 0; i < 2; ++ i )
+    {
+	file & f = d->files[i];
+	diff_lines[i] = prefix;
+	diff_first[i] = 0;
+	while ( more[i] )
+	{
+	    ++ diff_lines[i];
+	    if ( hashes[i].size() < MAX_DIFF_LINES )
+	    {
+		hashes[i].push_back ( hash[i] );
+		lines[i].push_back ( f.line_number );
+	    }
+	    else
+		diff_exceeded = true;
+	    more[i] = diff_line ( f, hash[i] );
+	}
+    }
+    d->close_files();
+    delete d;
+
+    // Skip the common suffix of lines.
+    //
+    int n = hashes[0].size();
+    int m = hashes[1].size();
+    long suffix = 0;
+    while ( ! diff_exceeded && n > 0 && m > 0
+            &&
+	    hashes[0][n-1] == hashes[1][m-1] )
+	-- n, -- m, ++ suffix;
+
+    vector<diff_edit> edits;
+    if ( ! diff_exceeded
+         &&
+	 ! myers_diff ( hashes[0].data(), n,
+	                hashes[1].data(), m,
+			diff_limit, edits ) )
+        diff_exceeded = true;
+
+    diffed = true;
+    diff_hunks.clear();
+    if ( diff_exceeded )
+    {
+	diff_matching = prefix;
+	for ( int i = 0; i < 2; ++ i )
+	    diff_first[i] = ( lines[i].empty() ? 0 :
+	                      lines[i][0] );
+	return;
+    }
+
+    // Group runs of edits with no matching lines
+    // between them into hunks.
+    //
+    int x = -1, y = -1;
+        // Position after the last edit.
+    int deleted = 0;
+    for ( size_t i = 0; i < edits.size(); ++ i )
+    {
+        diff_edit & e = edits[i];
+	if ( e.x != x || e.y != y )
+	{
+	    diff_hunk h;
+	    h.output_line = h.output_count = 0;
+	    h.test_line = h.test_count = 0;
+	    diff_hunks.push_back ( h );
+	}
+	diff_hunk & h = diff_hunks.back();
+	x = e.x, y = e.y;
+	if ( e.insert )
+	{
+	    if ( h.test_count ++ == 0 )
+	        h.test_line = lines[1][y];
+	    ++ y;
+	}
+	else
+	{
+	    if ( h.output_count ++ == 0 )
+	        h.output_line = lines[0][x];
+	    ++ x, ++ deleted;
+	}
+    }
+    diff_matching = prefix + suffix + n - deleted;
+}
+
+// Score the output file against the test file and
+// write the summary score and error descriptions to
+// out.  If chunks > 1, the files may be split into up
+// to that many chunks that are compared concurrently.
+// Returns false if either file could not be opened
+// or read to its end, after writing an ERROR line
+// (or -json error record) to out instead of a score.
+//
+bool job::score ( const char * output_file_name,
+                  const char * test_file_name,
+	          ostream & out, int chunks )
+{
+    start_time = now();
+    reset();
+    if ( ! open_files ( output_file_name,
+                        test_file_name, out ) )
+        return false;
+    if ( use_index && ! debug )
+        open_index ( test, test_file_name );
+    if ( chunks > 1 )
+        compare_chunks ( chunks );
+    else
+        compare();
+
+    // If the output is a pipe whose writer may still
+    // be writing, close it now, so the writer gets
+    // SIGPIPE instead of writing output that will not
+    // be read.
+    //
+    // The -diff reads the files again, so is only done
+    // if the output is a regular file.
+    //
+    bool rereadable = output.mapped;
+    struct stat st;
+    if (    output.fd >= 0
+         && fstat ( output.fd, & st ) == 0
+	 && S_ISREG ( st.st_mode ) )
+        rereadable = true;
+
+    if ( ! output.mapped && ! output.eof )
+        close_input ( output );
+    for ( int i = 0; i < 2; ++ i )
+    {
+        if ( files[i].read_error == NULL ) continue;
+	open_error ( out, files[i].read_error,
+	             i == 0 ? output_file_name
+		            : test_file_name );
+	close_files();
+	return false;
+    }
+    if ( diff_limit > 0
+         &&
+	 max_severity >= INCOMPLETE_OUTPUT
+	 &&
+	 output.line_number > 0
+	 &&
+	 rereadable )
+        diff ( output_file_name, test_file_name );
+    report ( out );
+    if ( stats && ! json )
+        report_stats ( out );
+    close_files();
+    return true;
+}
+
+
+// Batch mode entries, one per manifest line.
+//
+struct batch_entry
+{
+    string output_file;
+    string test_file;
+    string score_file;	// `-' for standard output.
+    string result;	// Output of scoring.
+    bool ok;		// False if a file could not be
+    			// read.
+    bool done;		// True when result is complete.
+};
+vector<batch_entry> batch;
+size_t batch_next = 0;
+    // Index of next batch entry to be scored.
+std::mutex batch_mutex;
+    // Protects batch_next and the result, ok, and
+    // done members of batch entries.
+std::condition_variable batch_done;
+    // Signalled when an entry becomes done.
+
+// Worker thread for batch mode: repeatedly take the
+// next batch entry and score it into its result.
+//
+void batch_worker ( void )
+{
+    job * j = new job;
+    while ( true )
+    {
+        size_t i;
+	{
+	    std::lock_guard<std::mutex>
+	        lock ( batch_mutex );
+	    if ( batch_next >= batch.size() ) break;
+	    i = batch_next ++;
+	}
+	batch_entry & b = batch[i];
+	std::ostringstream out;
+	bool ok = j->score ( b.output_file.c_str(),
+	                     b.test_file.c_str(), out );
+	{
+	    std::lock_guard<std::mutex>
+	        lock ( batch_mutex );
+	    b.result = out.str();
+	    b.ok = ok;
+	    b.done = true;
+	}
+	batch_done.notify_all();
+    }
+    delete j;
+}
+
+// Main program.
+//
+int main ( int argc, char ** argv )
+{
+    const char * batch_file = NULL;
+
+    // Process options.
+
+    while ( argc >= 2 && argv[1][0] == '-'
+		      && argv[1][1] != 0 )
+    {
+
+	const char * name = argv[1] + 1;
+
+        if ( strncmp ( "doc", name, 3 ) == 0 )
+	{
+	    // Any -doc* option prints documentation
+	    // and exits with no error.
+	    //
+	    FILE * out = popen ( "less -F", "w" );
+	    fputs ( documentation, out );
+	    pclose ( out );
+	    exit ( 0 );
+	}
+        else if ( strncmp ( "deb", name, 3 ) == 0 )
+	    debug = true;
+	else if ( strcmp ( "batch", name ) == 0 )
+	{
+	    if ( batch_file != NULL )
+	    {
+	        cerr << "too many " << argv[1]
+		     << " options";
+		exit ( 1 );
+	    }
+	    ++ argv, -- argc;
+	    if ( argc < 2 ) break;
+	    batch_file = argv[1];
+	}
+	else if ( strcmp ( "early", name ) == 0 )
+	    early = true;
+	else if ( strcmp ( "threads", name ) == 0 )
+	{
+	    if ( threads != 1 )
+	    {
+	        cerr << "too many " << argv[1]
+		     << " options";
+		exit ( 1 );
+	    }
+
+	    ++ argv, -- argc;
+	    if ( argc < 2 ) break;
+	    char * endp;
+	    threads = strtol ( argv[1], & endp, 10 );
+	    if ( * endp || threads < 1 )
+	    {
+		cerr << "Unrecognized N for"
+			" -threads: "
+		     << argv[1] << endl;
+		exit ( 1 );
+	    }
+	}
+	else if ( strcmp ( "limit", name ) == 0 )
+	{
+	    if ( limit != LIMIT )
+	    {
+	        cerr << "too many " << argv[1]
+		     << " options";
+		exit ( 1 );
+	    }
+
+	    ++ argv, -- argc;
+	    if ( argc < 2 ) break;
+	    char * endp;
+	    limit = strtol ( argv[1], & endp, 10 );
+	    if ( * endp || limit < 0 )
+	    {
+		cerr << "Unrecognized L for"
+			" -limit: "
+		     << argv[1] << endl;
+		exit ( 1 );
+	    }
+	}
+	else if ( strcmp ( "diff", name ) == 0 )
+	{
+	    if ( diff_limit != 0 )
+	    {
+	        cerr << "too many " << argv[1]
+		     << " options";
+		exit ( 1 );
+	    }
+
+	    ++ argv, -- argc;
+	    if ( argc < 2 ) break;
+	    char * endp;
+	    diff_limit = strtol ( argv[1], & endp, 10 );
+	    if (    * endp || diff_limit < 1
+	         || diff_limit > MAX_DIFF_LIMIT )
+	    {
+		cerr << "Unrecognized D for"
+			" -diff: "
+		     << argv[1] << endl;
+		exit ( 1 );
+	    }
+	}
+	else if ( strcmp ( "json", name ) == 0 )
+	    json = true;
+	else if ( strcmp ( "stats", name ) == 0 )
+	    stats = true;
+	else if ( strcmp ( "index", name ) == 0 )
+	    use_index = true;
+        else if ( strcmp ( "float", name ) == 0 )
+	{
+	    if ( float_opt )
+	    {
+	        cerr << "too many " << argv[1]
+		     << " options";
+		exit ( 1 );
+	    }
+	    float_opt = true;
+
+	    ++ argv, -- argc;
+	    if ( argc < 2 ) break;
+	    if ( strcmp ( "-", argv[1] ) == 0 )
+	        number_A = NAN;
+	    else
+	    {
+	        char * endp;
+		number_A = strtod ( argv[1], & endp );
+		if ( * endp )
+		{
+		    cerr << "Unrecognized A for"
+		            " -float: "
+			 << argv[1] << endl;
+		    exit ( 1 );
+		}
+	    }
+
+	    ++ argv, -- argc;
+	    if ( argc < 2 ) break;
+	    if ( strcmp ( "-", argv[1] ) == 0 )
+	        number_R = NAN;
+	    else
+	    {
+	        char * endp;
+		number_R = strtod ( argv[1], & endp );
+		if ( * endp )
+		{
+		    cerr << "Unrecognized R for"
+		            " -float: "
+			 << argv[1] << endl;
+		    exit ( 1 );
+		}
+	    }
+	    if (    isnan ( number_R )
+	         && isnan ( number_A ) )
+	    {
+		cerr << "BOTH A and R cannot be `-'"
+			" for -float" << endl;
+		exit ( 1 );
+	    }
+	}
+	else
+	{
+	    error_type * ep = last;
+	    bool found = false;
+	    while ( ep != NULL )
+	    {
+		error_type & e = * ep;
+		ep = e.previous;
+
+		if ( e.option_name == NULL ) continue;
+	        if (    strcmp ( name, e.option_name )
+		     != 0 )
+		    continue;
+		if ( ! e.ignore )
+		{
+		    cerr << "too many " << argv[1]
+			 << " options";
+		    exit ( 1 );
+		}
+		e.ignore = false;
+		found = true;
+	    }
+	    if ( ! found )
+	    {
+		cerr << "Unrecognized option -"
+		     << name
+		     << endl;
+		exit (1);
+	    }
+	}
+
+        ++ argv, -- argc;
+    }
+
+    if ( batch_file != NULL )
+    {
+        if ( argc > 1 )
+	{
+	    cerr << "file names not allowed with"
+	            " -batch" << endl;
+	    exit ( 1 );
+	}
+    }
+    else if ( argc < 3 )
+    {
+        cerr << "file name(s) missing"
+	     << endl;
+	exit ( 1 );
+    }
+    if ( argc > 3 )
+    {
+        cerr << "too many arguments"
+	     << endl;
+	exit ( 1 );
+    }
+    if ( batch_file == NULL
+         &&
+	 strcmp ( argv[1], "-" ) == 0
+	 &&
+	 strcmp ( argv[2], "-" ) == 0 )
+    {
+        cerr << "the standard input `-' can be read"
+	        " only once" << endl;
+	exit ( 1 );
+    }
+
+    ignore_blank =
+        superfluous_blank_line.ignore;
+    ignore_case =
+	word_letter_cases_do_not_match.ignore;
+    ignore_column =
+	token_end_columns_are_not_equal.ignore;
+    ignore_integer =
+	number_is_not_an_integer.ignore;
+    ignore_high_zero =
+	integer_has_high_order_zeros.ignore;
+    ignore_sign =
+	integer_has_sign.ignore;
+
+    if ( batch_file == NULL )
+    {
+        job * j = new job;
+        if ( ! j->score ( argv[1], argv[2], cout,
+	                  threads ) )
+	    exit ( 1 );
+	return 0;
+    }
+
+    // Batch mode.
+    //
+    ifstream manifest_stream;
+    std::istream * manifest = & cin;
+    if ( strcmp ( batch_file, "-" ) != 0 )
+    {
+        manifest_stream.open ( batch_file );
+	if ( ! manifest_stream )
+	{
+	    cerr << "cannot read -batch manifest "
+	         << batch_file << endl;
+	    exit ( 1 );
+	}
+	manifest = & manifest_stream;
+    }
+    bool ok = true;
+    string line;
+    int line_number = 0;
+    bool standard_input_used =
+        ( strcmp ( batch_file, "-" ) == 0 );
+    while ( getline ( * manifest, line ) )
+    {
+        ++ line_number;
+	istringstream in ( line );
+	batch_entry b;
+	string extra;
+	if ( ! ( in >> b.output_file ) ) continue;
+	if ( ! ( in >> b.test_file >> b.score_file )
+	     ||
+	     ( in >> extra ) )
+	{
+	    cerr << batch_file << ":" << line_number
+	         << ": expected output_file test_file"
+		    " score_file" << endl;
+	    ok = false;
+	    continue;
+	}
+	int standard_inputs = ( b.output_file == "-" )
+	                    + ( b.test_file == "-" );
+	if ( standard_inputs > 0
+	     &&
+	     ( standard_input_used
+	       ||
+	       standard_inputs > 1 ) )
+	{
+	    cerr << batch_file << ":" << line_number
+	         << ": the standard input `-' can be"
+		    " read only once" << endl;
+	    ok = false;
+	    continue;
+	}
+	if ( standard_inputs > 0 )
+	    standard_input_used = true;
+	b.ok = b.done = false;
+	batch.push_back ( b );
+    }
+
+    // Start the workers and write results in manifest
+    // order as they are completed.
+    //
+    vector<std::thread> workers;
+    for ( int i = 0; i < threads; ++ i )
+        workers.push_back ( std::thread ( batch_worker ) );
+    for ( size_t i = 0; i < batch.size(); ++ i )
+    {
+        batch_entry & b = batch[i];
+	{
+	    std::unique_lock<std::mutex>
+	        lock ( batch_mutex );
+	    while ( ! b.done ) batch_done.wait ( lock );
+	}
+	if ( ! b.ok ) ok = false;
+	if ( b.score_file == "-" )
+	    cout << b.result << std::flush;
+	else
+	{
+	    ofstream score_stream
+	        ( b.score_file.c_str() );
+	    score_stream << b.result;
+	    score_stream.close();
+	    if ( ! score_stream )
+	    {
+		cerr << "cannot write " << b.score_file
+		     << endl;
+		ok = false;
+	    }
+	}
+	string().swap ( b.result );
+    }
+    for ( int i = 0; i < threads; ++ i )
+        workers[i].join();
 
-    return 0;
+    return ( ok ? 0 : 1 );
 }
@@ -0,0 +1,562 @@
+// Educational Problem Manager Scoring Benchmark
+//
+// File:	epm_score_bench.cc
+// Authors:	agent (agent@local)
+// Date:	Sat Oct 17 23:16:26 UTC 2026
+//
+// The authors have placed this program in the public
+// domain; they make no warranty and accept no liability
+// for this program.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+extern "C" {
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <time.h>
+}
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+char documentation [] =
+"epm_score_bench [options]\n"
+"\n"
+"    Generates a corpus of synthetic output and test\n"
+"    file pairs and times epm_score on each pair,\n"
+"    printing for each the summary score, the best\n"
+"    time of several runs, and the throughput in MB\n"
+"    of both files per second and millions of tokens\n"
+"    of both files per second.  The cases are:\n"
+"\n"
+"        integers        integers of up to 19 digits\n"
+"                        and some of 100 digits\n"
+"        floats          floats printed differently\n"
+"                        in the two files, scored\n"
+"                        with -float 1e-6 1e-6\n"
+"        words           words of random letters\n"
+"        long_lines      lines of 50000 tokens\n"
+"        utf8            words with UTF-8 letters\n"
+"        comments        test file has a `!!' comment\n"
+"                        before every line\n"
+"        mismatch_start  words with an unequal word\n"
+"                        in the first line\n"
+"        mismatch_end    words with an unequal word\n"
+"                        in the last line\n"
+"\n"
+"    Options are:\n"
+"\n"
+"    -score PROGRAM\n"
+"        The epm_score program to time.  Defaults to\n"
+"        ./epm_score.\n"
+"\n"
+"    -dir DIRECTORY\n"
+"        Directory in which the corpus is written as\n"
+"        CASE.out and CASE.test files, and epm_score\n"
+"        output as CASE.score.  Defaults to\n"
+"        epm_score_bench.d.\n"
+"\n"
+"    -size MB\n"
+"        Size of each generated output file in mega-\n"
+"        bytes.  Defaults to 8.\n"
+"\n"
+"    -runs N\n"
+"        Number of times each case is scored; the\n"
+"        best time is reported.  Defaults to 3.\n"
+"\n"
+"    -reuse\n"
+"        Do not regenerate existing corpus files.\n"
+"        Token counts are then not known.\n"
+"\n"
+"    -case NAME\n"
+"        Only run the named case.  May be repeated.\n"
+"\n"
+"    -opt OPTION\n"
+"        Pass OPTION to epm_score before the options\n"
+"        of the case.  May be repeated, e.g., `-opt\n"
+"        -threads -opt 4'.\n"
+;
+
+// Random Number Generator
+// ------ ------ ---------
+
+// This is the same as the generator embedded in
+// epm_generate.cc, so the corpus cannot change when
+// the library changes.
+//
+# include <cmath>
+# define random RANDOM
+# define srandom SRANDOM
+    // To avoid conflict with libraries.
+unsigned long long last_random_number;
+const unsigned long long MAX_RANDOM_NUMBER =
+	( 1ull << 32 ) - 1;
+void srandom ( unsigned long long seed )
+{
+    seed &= MAX_RANDOM_NUMBER;
+    last_random_number = ( seed << 16 ) + 0x330E;
+}
+// Return floating point random number in range [0 .. 1)
+//
+inline double drandom ( void )
+{
+    last_random_number =
+        0x5DEECE66Dull * last_random_number + 0xB;
+    unsigned long long v =
+          ( last_random_number >> 16 )
+	& MAX_RANDOM_NUMBER;
+    return (double) v / (MAX_RANDOM_NUMBER + 1 );
+}
+// Return a random number in the range 0 .. n - 1.
+//
+inline unsigned long random ( unsigned long n )
+{
+    return (unsigned long) floor ( drandom() * n );
+}
+// Return a random number in the range [first,last].
+//
+inline long random ( long first, long last )
+{
+    assert ( first <= last );
+    return first + random ( last - first + 1 );
+}
+
+// Options:
+//
+const char * score_program = "./epm_score";
+const char * dir = "epm_score_bench.d";
+long size = 8;
+long runs = 3;
+bool reuse = false;
+vector<string> case_names;
+vector<string> score_options;
+
+// Corpus Generation
+// ------ ----------
+
+// A pair of files being generated.
+//
+struct pair
+{
+    FILE * out;
+    FILE * test;
+    long long out_bytes;	// Bytes written to out.
+    long long tokens;		// Tokens written to
+    				// both files.
+};
+
+// Write one line to each file, counting the tokens
+// of the lines.
+//
+void put_lines ( pair & p, const string & out_line,
+                 const string & test_line,
+		 int out_tokens, int test_tokens )
+{
+    fputs ( out_line.c_str(), p.out );
+    putc ( '\n', p.out );
+    fputs ( test_line.c_str(), p.test );
+    putc ( '\n', p.test );
+    p.out_bytes += out_line.size() + 1;
+    p.tokens += out_tokens + test_tokens;
+}
+
+// Append a random integer of n digits to s.
+//
+void integer ( string & s, int n )
+{
+    if ( random ( 4 ) == 0 ) s += '-';
+    s += (char) ( '1' + random ( 9 ) );
+    while ( -- n > 0 )
+        s += (char) ( '0' + random ( 10 ) );
+}
+
+// Append a random word of n letters to s.  If utf8,
+// some of the letters are 2 or 3 byte UTF-8 encodings.
+//
+void word ( string & s, int n, bool utf8 = false )
+{
+    static const char * letters[] = {
+        "\xc3\xa9", "\xce\xbb", "\xd0\x96",
+	"\xe4\xb8\xad", "\xe2\x82\xac" };
+    while ( n -- > 0 )
+    {
+        if ( utf8 && random ( 3 ) == 0 )
+	    s += letters[random ( 5 )];
+	else
+	    s += (char) ( 'a' + random ( 26 ) );
+    }
+}
+
+// Generate a line of words for the words, utf8,
+// comments, and mismatch cases.
+//
+int word_line ( string & s, bool utf8 = false )
+{
+    int n = random ( 4, 16 );
+    for ( int i = 0; i < n; ++ i )
+    {
+        if ( i > 0 ) s += ' ';
+	word ( s, random ( 1, 12 ), utf8 );
+    }
+    return n + 1;
+}
+
+// Generate the lines of case name into p until the
+// output file is at least size megabytes.
+//
+void generate ( const string & name, pair & p )
+{
+    long long limit = size << 20;
+    bool first = true;
+    while ( p.out_bytes < limit )
+    {
+        string o, t;
+	int n;
+	if ( name == "integers" )
+	{
+	    n = 10;
+	    for ( int i = 0; i < n; ++ i )
+	    {
+	        if ( i > 0 ) t += ' ';
+		integer ( t, random ( 50 ) == 0 ?
+		             100 : random ( 1, 19 ) );
+	    }
+	    put_lines ( p, t, t, n + 1, n + 1 );
+	}
+	else if ( name == "floats" )
+	{
+	    n = 8;
+	    for ( int i = 0; i < n; ++ i )
+	    {
+		double x = ( drandom() - 0.5 )
+		         * pow ( 10, random ( -5, 8 ) );
+		int digits = random ( 8, 12 );
+		char buffer[100];
+	        if ( i > 0 ) o += ' ', t += ' ';
+		sprintf ( buffer, "%.*g", digits, x );
+		t += buffer;
+		sprintf ( buffer, "%.*g", digits + 1,
+		          x * ( 1 + 1e-9 ) );
+		o += buffer;
+	    }
+	    put_lines ( p, o, t, n + 1, n + 1 );
+	}
+	else if ( name == "words" )
+	{
+	    n = word_line ( t );
+	    put_lines ( p, t, t, n, n );
+	}
+	else if ( name == "long_lines" )
+	{
+	    n = 50000;
+	    for ( int i = 0; i < n; ++ i )
+	    {
+	        if ( i > 0 ) t += ' ';
+		if ( i % 2 )
+		    integer ( t, random ( 1, 9 ) );
+		else
+		    word ( t, random ( 1, 8 ) );
+	    }
+	    put_lines ( p, t, t, n + 1, n + 1 );
+	}
+	else if ( name == "utf8" )
+	{
+	    n = word_line ( t, true );
+	    put_lines ( p, t, t, n, n );
+	}
+	else if ( name == "comments" )
+	{
+	    fputs ( "!! comment line that is"
+	            " skipped\n", p.test );
+	    n = word_line ( t );
+	    put_lines ( p, t, t, n, n );
+	}
+	else if ( name == "mismatch_start"
+	          ||
+		  name == "mismatch_end" )
+	{
+	    n = word_line ( t );
+	    o = t;
+	    bool last = ( p.out_bytes + 200 >= limit );
+	    if ( name == "mismatch_start" ? first
+	                                  : last )
+	        o[0] = ( o[0] == 'x' ? 'y' : 'x' );
+	    put_lines ( p, o, t, n, n );
+	}
+	else
+	{
+	    cerr << "unknown case " << name << endl;
+	    exit ( 1 );
+	}
+	first = false;
+    }
+}
+
+// Benchmark Harness
+// --------- -------
+
+struct bench_case
+{
+    const char * name;
+    const char * options;	// Space separated
+    				// epm_score options.
+};
+bench_case cases[] = {
+    { "integers", "" },
+    { "floats", "-float 1e-6 1e-6" },
+    { "words", "" },
+    { "long_lines", "" },
+    { "utf8", "" },
+    { "comments", "" },
+    { "mismatch_start", "" },
+    { "mismatch_end", "" } };
+int const NUMBER_OF_CASES =
+    sizeof ( cases ) / sizeof ( cases[0] );
+
+// Return the current monotonic time in seconds.
+//
+double now ( void )
+{
+    struct timespec t;
+    clock_gettime ( CLOCK_MONOTONIC, & t );
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Run the score program on case c writing its output
+// to the score file, and return the elapsed time.
+//
+double run ( const bench_case & c )
+{
+    string base = string ( dir ) + "/" + c.name;
+    string out = base + ".out";
+    string test = base + ".test";
+    string score = base + ".score";
+
+    vector<string> args;
+    args.push_back ( score_program );
+    for ( size_t i = 0; i < score_options.size(); ++ i )
+        args.push_back ( score_options[i] );
+    string options = c.options;
+    size_t i = 0;
+    while ( i < options.size() )
+    {
+        size_t j = options.find ( ' ', i );
+	if ( j == string::npos ) j = options.size();
+	args.push_back ( options.substr ( i, j - i ) );
+	i = j + 1;
+    }
+    args.push_back ( out );
+    args.push_back ( test );
+    vector<char *> argv;
+    for ( size_t i = 0; i < args.size(); ++ i )
+        argv.push_back ( (char *) args[i].c_str() );
+    argv.push_back ( NULL );
+
+    double start = now();
+    pid_t pid = fork();
+    if ( pid < 0 )
+    {
+        perror ( "fork" );
+	exit ( 1 );
+    }
+    if ( pid == 0 )
+    {
+        int fd = open ( score.c_str(),
+	                O_WRONLY|O_CREAT|O_TRUNC, 0644 );
+	if ( fd < 0 || dup2 ( fd, 1 ) < 0 )
+	{
+	    perror ( score.c_str() );
+	    _exit ( 1 );
+	}
+	execvp ( argv[0], & argv[0] );
+	perror ( argv[0] );
+	_exit ( 1 );
+    }
+    int status;
+    while ( waitpid ( pid, & status, 0 ) < 0 )
+    {
+        if ( errno == EINTR ) continue;
+	perror ( "waitpid" );
+	exit ( 1 );
+    }
+    double time = now() - start;
+    if ( ! WIFEXITED ( status )
+         ||
+	 WEXITSTATUS ( status ) != 0 )
+    {
+        cerr << score_program << " failed on "
+	     << c.name << endl;
+	exit ( 1 );
+    }
+    return time;
+}
+
+// Return the first line of file, or "" if none.
+//
+string first_line ( const string & file )
+{
+    char buffer[200] = "";
+    FILE * f = fopen ( file.c_str(), "r" );
+    if ( f == NULL ) return "";
+    if ( fgets ( buffer, sizeof ( buffer ), f )
+         == NULL )
+        buffer[0] = 0;
+    fclose ( f );
+    char * nl = strchr ( buffer, '\n' );
+    if ( nl ) * nl = 0;
+    return buffer;
+}
+
+// Return the size of file, or 0 if not readable.
+//
+long long file_size ( const string & file )
+{
+    struct stat st;
+    if ( stat ( file.c_str(), & st ) < 0 ) return 0;
+    return st.st_size;
+}
+
+// Main program.
+//
+int main ( int argc, char ** argv )
+{
+    while ( argc >= 2 && argv[1][0] == '-' )
+    {
+	const char * name = argv[1] + 1;
+        if ( strncmp ( "doc", name, 3 ) == 0 )
+	{
+	    FILE * out = popen ( "less -F", "w" );
+	    fputs ( documentation, out );
+	    pclose ( out );
+	    exit ( 0 );
+	}
+	else if ( strcmp ( "reuse", name ) == 0 )
+	    reuse = true;
+	else if ( argc < 3 )
+	{
+	    cerr << "missing argument for " << argv[1]
+	         << endl;
+	    exit ( 1 );
+	}
+	else
+	{
+	    const char * value = argv[2];
+	    ++ argv, -- argc;
+	    if ( strcmp ( "score", name ) == 0 )
+		score_program = value;
+	    else if ( strcmp ( "dir", name ) == 0 )
+		dir = value;
+	    else if ( strcmp ( "case", name ) == 0 )
+		case_names.push_back ( value );
+	    else if ( strcmp ( "opt", name ) == 0 )
+		score_options.push_back ( value );
+	    else if ( strcmp ( "size", name ) == 0
+	              ||
+		      strcmp ( "runs", name ) == 0 )
+	    {
+		char * endp;
+		long n = strtol ( value, & endp, 10 );
+		if ( * endp || n < 1 )
+		{
+		    cerr << "bad " << argv[0]
+			 << " value: " << value << endl;
+		    exit ( 1 );
+		}
+		( name[0] == 's' ? size : runs ) = n;
+	    }
+	    else
+	    {
+		cerr << "Unrecognized option "
+		     << argv[0] << endl;
+		exit ( 1 );
+	    }
+	}
+        ++ argv, -- argc;
+    }
+    if ( argc != 1 )
+    {
+        cerr << "Wrong number of arguments" << endl;
+	exit ( 1 );
+    }
+    mkdir ( dir, 0755 );
+
+    char buffer[200];
+    sprintf ( buffer, "%-16s %-20s %8s %9s %8s %10s",
+              "case", "score", "MB", "seconds",
+	      "MB/s", "Mtokens/s" );
+    cout << buffer << endl;
+
+    for ( int i = 0; i < NUMBER_OF_CASES; ++ i )
+    {
+        bench_case & c = cases[i];
+	if ( ! case_names.empty() )
+	{
+	    bool found = false;
+	    for ( size_t j = 0; j < case_names.size();
+	                        ++ j )
+	        found |= ( case_names[j] == c.name );
+	    if ( ! found ) continue;
+	}
+
+	string base = string ( dir ) + "/" + c.name;
+	long long tokens = 0;
+	if ( ! reuse
+	     ||
+	     file_size ( base + ".out" ) == 0 )
+	{
+	    pair p;
+	    p.out = fopen ( ( base + ".out" ).c_str(),
+	                    "w" );
+	    p.test = fopen ( ( base + ".test" ).c_str(),
+	                     "w" );
+	    if ( p.out == NULL || p.test == NULL )
+	    {
+	        cerr << "cannot write " << base
+		     << ".out/.test" << endl;
+		exit ( 1 );
+	    }
+	    p.out_bytes = p.tokens = 0;
+	    srandom ( 1000 + i );
+	    generate ( c.name, p );
+	    fclose ( p.out );
+	    fclose ( p.test );
+	    tokens = p.tokens;
+	}
+
+	double best = 0;
+	for ( int r = 0; r < runs; ++ r )
+	{
+	    double t = run ( c );
+	    if ( r == 0 || t < best ) best = t;
+	}
+	double MB = ( file_size ( base + ".out" )
+	              + file_size ( base + ".test" ) )
+		  / 1048576.0;
+	string score = first_line ( base + ".score" );
+	if ( tokens > 0 )
+	    sprintf ( buffer,
+		      "%-16s %-20s %8.1f %9.4f %8.1f"
+		      " %10.2f",
+		      c.name, score.c_str(), MB, best,
+		      MB / best, tokens / best / 1e6 );
+	else
+	    sprintf ( buffer,
+		      "%-16s %-20s %8.1f %9.4f %8.1f"
+		      " %10s",
+		      c.name, score.c_str(), MB, best,
+		      MB / best, "-" );
+	cout << buffer << endl;
+    }
+    return 0;
+}